@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "analyze.h"
+
+#define CACHE_MAGIC 0x41385043  // "CP8A"
+
+#define I_UNKNOWN 0xFFFF
+
+#define NEXT(pc, n) (((pc) + (n)) & 0xFFF)
+
+typedef struct {
+    uint16_t pc;
+    uint16_t I;     // value of I on entry, or I_UNKNOWN
+} work_item_t;
+
+// FNV-1a
+uint64_t rom_hash(const uint8_t *rom, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= rom[i];
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+bool idle_opcode(uint16_t opcode) {
+    switch ((opcode >> 12) & 0x0F) {
+        case 0x01:      // jump
+        case 0x03:      // skips only read registers
+        case 0x04:
+        case 0x05:
+        case 0x09:
+            return true;
+
+        case 0x0E:
+            return (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1;
+
+        case 0x0F:
+            // delay timer and keys only change between frames
+            return (opcode & 0xFF) == 0x07 || (opcode & 0xFF) == 0x0A;
+
+        default:
+            return false;
+    }
+}
+
+static void mark_data(rom_analysis_t *out, uint16_t I, uint32_t len) {
+    if (I == I_UNKNOWN) return;
+
+    for (uint32_t a = I; a < (uint32_t) I + len && a < ANALYSIS_RAM_SIZE; a++)
+        out->kind[a] |= BYTE_DATA;
+}
+
+static bool in_rom(const rom_analysis_t *out, uint32_t pc) {
+    return pc >= ANALYSIS_ROM_START && pc + 1 < (uint32_t) ANALYSIS_ROM_START + out->rom_size;
+}
+
+// true if the instruction at pc can not fall through to pc + 2
+static bool ends_block(uint16_t opcode) {
+    switch ((opcode >> 12) & 0x0F) {
+        case 0x0:
+            return (opcode & 0xFF) == 0xEE;
+
+        case 0x01:
+        case 0x02:
+        case 0x03:
+        case 0x04:
+        case 0x05:
+        case 0x09:
+        case 0x0B:
+            return true;
+
+        case 0x0E:
+            return (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1;
+
+        default:
+            return false;
+    }
+}
+
+static uint16_t fetch(const uint8_t *ram, uint16_t pc) {
+    return ram[pc] << 8 | ram[pc + 1];
+}
+
+// follows every reachable path from 0x200, marking code, data and block leaders
+static void discover(const uint8_t *ram, rom_analysis_t *out) {
+    static work_item_t work[ANALYSIS_RAM_SIZE * 2];
+    static bool visited[ANALYSIS_RAM_SIZE];
+    uint32_t top = 0;
+
+    memset(visited, 0, sizeof(visited));
+
+    work[top++] = (work_item_t){ .pc = ANALYSIS_ROM_START, .I = I_UNKNOWN };
+    out->block_start[ANALYSIS_ROM_START] = true;
+
+    while (top) {
+        work_item_t item = work[--top];
+        uint16_t pc = item.pc;
+        uint16_t I = item.I;
+
+        // straight line walk until the path ends or joins a visited one
+        while (in_rom(out, pc) && !visited[pc]) {
+            const uint16_t opcode = fetch(ram, pc);
+            const uint16_t NNN = opcode & 0x0FFF;
+            const uint8_t NN = opcode & 0xFF;
+            const uint8_t X = (opcode >> 8) & 0x0F;
+
+            visited[pc] = true;
+            out->kind[pc] |= BYTE_CODE | BYTE_OPCODE;
+            out->kind[pc + 1] |= BYTE_CODE;
+
+            switch ((opcode >> 12) & 0x0F) {
+                case 0x0:
+                    if (NN == 0xEE) goto next_path;
+                    break;
+
+                case 0x01:
+                    out->block_start[NNN] = true;
+                    work[top++] = (work_item_t){ .pc = NNN, .I = I };
+                    goto next_path;
+
+                case 0x02:
+                    // the callee and the return address both start blocks
+                    out->block_start[NNN] = true;
+                    out->block_start[NEXT(pc, 2)] = true;
+                    work[top++] = (work_item_t){ .pc = NNN, .I = I };
+                    work[top++] = (work_item_t){ .pc = NEXT(pc, 2), .I = I_UNKNOWN };
+                    goto next_path;
+
+                case 0x03:
+                case 0x04:
+                case 0x05:
+                case 0x09:
+                    out->block_start[NEXT(pc, 2)] = true;
+                    out->block_start[NEXT(pc, 4)] = true;
+                    work[top++] = (work_item_t){ .pc = NEXT(pc, 4), .I = I };
+                    work[top++] = (work_item_t){ .pc = NEXT(pc, 2), .I = I };
+                    goto next_path;
+
+                case 0x0A:
+                    I = NNN;
+                    break;
+
+                case 0x0B:
+                    goto next_path;     // target depends on V0
+
+                case 0x0D:
+                    mark_data(out, I, opcode & 0x0F);
+                    break;
+
+                case 0x0E:
+                    if (NN == 0x9E || NN == 0xA1) {
+                        out->block_start[NEXT(pc, 2)] = true;
+                        out->block_start[NEXT(pc, 4)] = true;
+                        work[top++] = (work_item_t){ .pc = NEXT(pc, 4), .I = I };
+                        work[top++] = (work_item_t){ .pc = NEXT(pc, 2), .I = I };
+                        goto next_path;
+                    }
+                    break;
+
+                case 0x0F:
+                    if (NN == 0x1E || NN == 0x29) I = I_UNKNOWN;
+                    else if (NN == 0x33) mark_data(out, I, 3);
+                    else if (NN == 0x55 || NN == 0x65) mark_data(out, I, X + 1);
+                    break;
+
+                default:
+                    break;
+            }
+
+            pc += 2;
+        }
+next_path:
+        ;
+    }
+}
+
+// splits the discovered code into blocks at every leader
+static void build_blocks(const uint8_t *ram, rom_analysis_t *out) {
+    out->block_count = 0;
+
+    for (uint32_t start = ANALYSIS_ROM_START; start < ANALYSIS_RAM_SIZE; start++) {
+        if (!out->block_start[start] || !(out->kind[start] & BYTE_OPCODE)) continue;
+        if (out->block_count == ANALYSIS_MAX_BLOCKS) return;
+
+        basic_block_t *b = &out->blocks[out->block_count++];
+        *b = (basic_block_t){ .start = start };
+
+        uint32_t pc = start;
+        uint16_t opcode;
+        for (;;) {
+            opcode = fetch(ram, pc);
+            pc += 2;
+
+            if (ends_block(opcode) || !in_rom(out, pc) || out->block_start[pc] ||
+                !(out->kind[pc] & BYTE_OPCODE))
+                break;
+        }
+        b->end = pc;
+
+        const uint16_t last = pc - 2;
+        switch ((opcode >> 12) & 0x0F) {
+            case 0x0:
+                if ((opcode & 0xFF) == 0xEE) b->returns = true;
+                else b->succ[b->succ_count++] = pc;
+                break;
+
+            case 0x01:
+                b->succ[b->succ_count++] = opcode & 0x0FFF;
+                break;
+
+            case 0x02:
+                b->succ[b->succ_count++] = opcode & 0x0FFF;
+                b->succ[b->succ_count++] = pc;
+                break;
+
+            case 0x0B:
+                b->indirect = true;
+                break;
+
+            default:
+                if (ends_block(opcode)) {
+                    // skip
+                    b->succ[b->succ_count++] = last + 2;
+                    b->succ[b->succ_count++] = NEXT(last, 4);
+                }
+                else {
+                    b->succ[b->succ_count++] = pc;
+                }
+                break;
+        }
+    }
+}
+
+/* A backward jump whose whole range is made of idle opcodes can only spin
+ * until the delay timer or the keys change, which happens between frames.
+ */
+static void find_idle_loops(const uint8_t *ram, rom_analysis_t *out) {
+    for (uint32_t pc = ANALYSIS_ROM_START; pc + 1 < ANALYSIS_RAM_SIZE; pc++) {
+        if (!(out->kind[pc] & BYTE_OPCODE)) continue;
+
+        const uint16_t opcode = fetch(ram, pc);
+
+        // Fx0A waits on itself
+        if ((opcode & 0xF0FF) == 0xF00A) {
+            out->idle_head[pc] = true;
+            out->idle_body[pc] = true;
+            continue;
+        }
+
+        if ((opcode & 0xF000) != 0x1000) continue;
+
+        const uint16_t target = opcode & 0x0FFF;
+        if (target > pc || target < ANALYSIS_ROM_START || (pc - target) % 2) continue;
+
+        bool idle = true;
+        for (uint32_t a = target; a <= pc && idle; a += 2)
+            idle = (out->kind[a] & BYTE_OPCODE) && idle_opcode(fetch(ram, a));
+
+        if (!idle) continue;
+
+        out->idle_head[target] = true;
+        for (uint32_t a = target; a <= pc; a += 2) out->idle_body[a] = true;
+    }
+}
+
+void analyze_rom(const uint8_t *rom, size_t size, rom_analysis_t *out) {
+    uint8_t ram[ANALYSIS_RAM_SIZE + 1] = {0};     // one spare byte so fetch never reads past
+
+    if (size > ANALYSIS_RAM_SIZE - ANALYSIS_ROM_START) size = ANALYSIS_RAM_SIZE - ANALYSIS_ROM_START;
+    memcpy(&ram[ANALYSIS_ROM_START], rom, size);
+
+    memset(out, 0, sizeof(*out));
+    out->rom_hash = rom_hash(rom, size);
+    out->rom_size = size;
+
+    discover(ram, out);
+    build_blocks(ram, out);
+    find_idle_loops(ram, out);
+}
+
+// $XDG_CACHE_HOME/chip8 or ~/.cache/chip8
+static bool cache_path(uint64_t hash, char *path, size_t len) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[4096];
+
+    if (xdg && *xdg) snprintf(dir, sizeof(dir), "%s", xdg);
+    else if (home && *home) snprintf(dir, sizeof(dir), "%s/.cache", home);
+    else return false;
+
+    mkdir(dir, 0755);
+    strncat(dir, "/chip8", sizeof(dir) - strlen(dir) - 1);
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return false;
+
+    snprintf(path, len, "%s/%016llx.cfg", dir, (unsigned long long) hash);
+    return true;
+}
+
+bool analyze_rom_cached(const uint8_t *rom, size_t size, rom_analysis_t *out) {
+    if (size == 0 || size > ANALYSIS_RAM_SIZE - ANALYSIS_ROM_START) return false;
+
+    const uint64_t hash = rom_hash(rom, size);
+    char path[4096];
+    const bool cacheable = cache_path(hash, path, sizeof(path));
+
+    if (cacheable) {
+        FILE *in = fopen(path, "rb");
+        if (in) {
+            uint32_t header[2];
+            const bool ok = fread(header, sizeof(header), 1, in) == 1 &&
+                            header[0] == CACHE_MAGIC && header[1] == ANALYSIS_VERSION &&
+                            fread(out, sizeof(*out), 1, in) == 1 &&
+                            out->rom_hash == hash && out->rom_size == size;
+            fclose(in);
+            if (ok) return true;
+        }
+    }
+
+    analyze_rom(rom, size, out);
+
+    if (cacheable) {
+        // write then rename so a concurrent reader never sees half a file
+        char tmp_path[4200];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int) getpid());
+
+        FILE *cache = fopen(tmp_path, "wb");
+        if (cache) {
+            const uint32_t header[2] = { CACHE_MAGIC, ANALYSIS_VERSION };
+            const bool ok = fwrite(header, sizeof(header), 1, cache) == 1 &&
+                            fwrite(out, sizeof(*out), 1, cache) == 1;
+            fclose(cache);
+            if (ok) rename(tmp_path, path);
+            else remove(tmp_path);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Static analysis of a rom image loaded at 0x200: walks every reachable
+ * instruction following jumps, calls and skips, marks the bytes sprite and
+ * register load/store instructions point I at, splits the code into basic
+ * blocks and finds loops that can not make progress before the next frame.
+ * Results are cached on disk keyed by the rom hash.
+ */
+
+#define ANALYSIS_RAM_SIZE 0x1000
+#define ANALYSIS_ROM_START 0x200u
+#define ANALYSIS_MAX_BLOCKS 0x800     // one per instruction slot at most
+#define ANALYSIS_VERSION 1
+
+// byte classification, a byte can be both when code is also read as data
+#define BYTE_CODE 0x01
+#define BYTE_DATA 0x02
+#define BYTE_OPCODE 0x04    // first byte of a reachable instruction
+
+typedef struct {
+    uint16_t start;             // first instruction
+    uint16_t end;               // one past the last instruction
+    uint16_t succ[2];
+    uint8_t succ_count;
+    bool indirect;              // ends in BNNN, successors unknown
+    bool returns;               // ends in 00EE
+} basic_block_t;
+
+typedef struct {
+    uint64_t rom_hash;
+    uint16_t rom_size;
+    uint8_t kind[ANALYSIS_RAM_SIZE];        // BYTE_* flags per address
+    bool block_start[ANALYSIS_RAM_SIZE];
+    bool idle_head[ANALYSIS_RAM_SIZE];      // first instruction of an idle loop
+    bool idle_body[ANALYSIS_RAM_SIZE];      // instruction inside an idle loop
+    uint16_t block_count;
+    basic_block_t blocks[ANALYSIS_MAX_BLOCKS];
+} rom_analysis_t;
+
+uint64_t rom_hash(const uint8_t *rom, size_t size);
+
+void analyze_rom(const uint8_t *rom, size_t size, rom_analysis_t *out);
+
+// loads from the cache or analyzes and stores, false only if rom is unusable
+bool analyze_rom_cached(const uint8_t *rom, size_t size, rom_analysis_t *out);
+
+// instructions an idle loop may contain, none of them change state within a frame
+bool idle_opcode(uint16_t opcode);
+
+#endif
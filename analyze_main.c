@@ -0,0 +1,100 @@
+/* chip8-analyze: prints the control flow graph, code/data map and idle
+ * loops of a rom, and fills the analysis cache the emulator uses at load.
+ *
+ * usage: chip8-analyze rom/file/path [-map] [-dot]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "analyze.h"
+
+static rom_analysis_t analysis;
+
+static void print_map() {
+    printf("\nmap (C code, D data, B both, . unreached):\n");
+
+    for (uint32_t a = ANALYSIS_ROM_START; a < ANALYSIS_ROM_START + analysis.rom_size; a++) {
+        if ((a - ANALYSIS_ROM_START) % 64 == 0) printf("%s0x%03X ", a == ANALYSIS_ROM_START ? "" : "\n", a);
+
+        const uint8_t kind = analysis.kind[a] & (BYTE_CODE | BYTE_DATA);
+        putchar(kind == (BYTE_CODE | BYTE_DATA) ? 'B' : kind == BYTE_CODE ? 'C' : kind == BYTE_DATA ? 'D' : '.');
+    }
+    printf("\n");
+}
+
+static void print_dot() {
+    printf("digraph rom_%016llx {\n    node [shape=box fontname=monospace];\n",
+           (unsigned long long) analysis.rom_hash);
+
+    for (uint16_t i = 0; i < analysis.block_count; i++) {
+        const basic_block_t *b = &analysis.blocks[i];
+
+        printf("    b%03X [label=\"0x%03X-0x%03X%s%s\"%s];\n", b->start, b->start, b->end - 2,
+               b->returns ? "\\nreturn" : "", b->indirect ? "\\nindirect" : "",
+               analysis.idle_head[b->start] ? " style=filled" : "");
+        for (uint8_t s = 0; s < b->succ_count; s++)
+            printf("    b%03X -> b%03X;\n", b->start, b->succ[s]);
+    }
+
+    printf("}\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s rom/file/path [-map] [-dot]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *rom_ptr = fopen(argv[1], "rb");
+    if (!rom_ptr) {
+        fprintf(stderr, "Unable to open rom file: %s\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t rom[ANALYSIS_RAM_SIZE - ANALYSIS_ROM_START];
+    const size_t rom_size = fread(rom, 1, sizeof(rom), rom_ptr);
+    const bool too_big = fgetc(rom_ptr) != EOF;
+    fclose(rom_ptr);
+
+    if (!analyze_rom_cached(rom, rom_size, &analysis) || too_big) {
+        fprintf(stderr, "Rom file is empty or does not fit in Ram: %s\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-dot") == 0) {
+            print_dot();
+            exit(EXIT_SUCCESS);
+        }
+    }
+
+    uint32_t code = 0, data = 0, both = 0;
+    for (uint32_t a = ANALYSIS_ROM_START; a < ANALYSIS_ROM_START + analysis.rom_size; a++) {
+        if ((analysis.kind[a] & BYTE_CODE) && (analysis.kind[a] & BYTE_DATA)) both++;
+        else if (analysis.kind[a] & BYTE_CODE) code++;
+        else if (analysis.kind[a] & BYTE_DATA) data++;
+    }
+
+    printf("rom %s, %u bytes, hash %016llx\n", argv[1], analysis.rom_size, (unsigned long long) analysis.rom_hash);
+    printf("code %u bytes, data %u bytes, both %u bytes, unreached %u bytes\n",
+           code, data, both, analysis.rom_size - code - data - both);
+
+    printf("\n%u basic blocks:\n", analysis.block_count);
+    for (uint16_t i = 0; i < analysis.block_count; i++) {
+        const basic_block_t *b = &analysis.blocks[i];
+
+        printf("  0x%03X-0x%03X", b->start, b->end - 2);
+        if (b->returns) printf(" return");
+        if (b->indirect) printf(" indirect");
+        if (b->succ_count) printf(" ->");
+        for (uint8_t s = 0; s < b->succ_count; s++) printf(" 0x%03X", b->succ[s]);
+        if (analysis.idle_head[b->start]) printf(" (idle loop)");
+        printf("\n");
+    }
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-map") == 0) print_map();
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,819 @@
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "font.h"
+
+#define RAM_SIZE 0x1000
+#define ROM_START 0x200
+
+#define SHARD_ALIGN 64          // a cache line of one uint8_t register row
+
+#define REG(b, r) ((b)->V + (size_t)(r) * (b)->lanes)
+#define LANE_RAM(b, l) ((b)->ram + (size_t)(l) * BATCH_RAM_STRIDE)
+
+/* Lanes only get their own copy of a block of ram once they store to it,
+ * until then reads go to the shared image, which stays in cache.
+ */
+#define BLOCK_SHIFT 6
+#define READ_RAM(b, l, addr) \
+    (((b)->written[l] >> ((addr) >> BLOCK_SHIFT) & 1) ? LANE_RAM(b, l)[addr] : (b)->image[addr])
+
+/* Runs the body over lanes [lo, hi) with m set on the lanes at address
+ * at that were not stepped yet, which are marked done and moved past the
+ * instruction first. The loop is contiguous with no branches so it
+ * vectorizes; bodies only store under m.
+ */
+#define SELECTED(l) ((pc[l] == at) & (done[l] ^ 1))
+
+#define FOR_LANES(...)                                                  \
+    for (uint32_t l = lo; l < hi; l++) {                                \
+        const uint8_t m = SELECTED(l);                                  \
+        done[l] |= m;                                                   \
+        pc[l] += m << 1;                                                \
+        __VA_ARGS__;                                                    \
+    }
+
+static void free_shards(chip8_batch_t *b) {
+    for (uint32_t s = 0; s < b->shard_count; s++) {
+        free(b->shards[s].done);
+        free(b->shards[s].sel);
+        free(b->shards[s].list);
+    }
+    free(b->shards);
+    b->shards = NULL;
+    b->shard_count = 0;
+}
+
+chip8_batch_t *batch_create(uint32_t lanes, const uint8_t *rom, size_t rom_size, uint32_t instr_per_frame) {
+    if (lanes == 0 || rom_size > RAM_SIZE - ROM_START) return NULL;
+
+    chip8_batch_t *b = calloc(1, sizeof *b);
+    if (!b) return NULL;
+
+    b->lanes = lanes;
+    b->instr_per_frame = instr_per_frame;
+
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->wake, NULL);
+    pthread_cond_init(&b->idle, NULL);
+
+    b->V = calloc((size_t) lanes * 16, sizeof *b->V);
+    b->PC = calloc(lanes, sizeof *b->PC);
+    b->I = calloc(lanes, sizeof *b->I);
+    b->SP = calloc(lanes, sizeof *b->SP);
+    b->stack = calloc((size_t) lanes * BATCH_STACK_SIZE, sizeof *b->stack);
+    b->delay_timer = calloc(lanes, sizeof *b->delay_timer);
+    b->sound_timer = calloc(lanes, sizeof *b->sound_timer);
+    b->keys = calloc(lanes, sizeof *b->keys);
+    b->rng = calloc(lanes, sizeof *b->rng);
+    b->fault = calloc(lanes, sizeof *b->fault);
+    b->ram = calloc((size_t) lanes * BATCH_RAM_STRIDE, sizeof *b->ram);
+    b->written = calloc(lanes, sizeof *b->written);
+    b->display = calloc((size_t) lanes * BATCH_DISPLAY_ROWS, sizeof *b->display);
+
+    if (!b->V || !b->PC || !b->I || !b->SP || !b->stack || !b->delay_timer || !b->sound_timer ||
+        !b->keys || !b->rng || !b->fault || !b->ram || !b->written || !b->display ||
+        !batch_set_threads(b, 1)) {
+        batch_destroy(b);
+        return NULL;
+    }
+
+    memcpy(&b->image[0], font_set, sizeof(font_set));
+    memcpy(&b->image[ROM_START], rom, rom_size);
+
+    batch_reset(b, 1);
+
+    return b;
+}
+
+static void stop_threads(chip8_batch_t *b) {
+    if (!b->threads) return;
+
+    pthread_mutex_lock(&b->lock);
+    b->quit = true;
+    pthread_cond_broadcast(&b->wake);
+    pthread_mutex_unlock(&b->lock);
+
+    for (uint32_t s = 1; s < b->shard_count; s++) pthread_join(b->threads[s], NULL);
+
+    free(b->threads);
+    b->threads = NULL;
+    b->quit = false;
+}
+
+void batch_destroy(chip8_batch_t *b) {
+    if (!b) return;
+
+    stop_threads(b);
+    free_shards(b);
+
+    pthread_mutex_destroy(&b->lock);
+    pthread_cond_destroy(&b->wake);
+    pthread_cond_destroy(&b->idle);
+
+    free(b->V);
+    free(b->PC);
+    free(b->I);
+    free(b->SP);
+    free(b->stack);
+    free(b->delay_timer);
+    free(b->sound_timer);
+    free(b->keys);
+    free(b->rng);
+    free(b->fault);
+    free(b->ram);
+    free(b->written);
+    free(b->display);
+    free(b);
+}
+
+void batch_set_reward_hook(chip8_batch_t *b, batch_reward_fn fn, void *userdata) {
+    b->reward_fn = fn;
+    b->reward_userdata = userdata;
+}
+
+static batch_shard_t *lane_shard(chip8_batch_t *b, uint32_t lane) {
+    uint32_t s = 0;
+    while (lane >= b->shards[s].hi) s++;
+
+    return &b->shards[s];
+}
+
+void batch_reset_lane(chip8_batch_t *b, uint32_t lane) {
+    const uint32_t n = b->lanes;
+
+    for (uint32_t r = 0; r < 16; r++) b->V[r * n + lane] = 0;
+    for (uint32_t d = 0; d < BATCH_STACK_SIZE; d++) b->stack[d * n + lane] = 0;
+
+    b->PC[lane] = ROM_START;
+    b->I[lane] = 0;
+    b->SP[lane] = 0;
+    b->delay_timer[lane] = 0;
+    b->sound_timer[lane] = 0;
+    b->keys[lane] = 0;
+
+    // xorshift must never be seeded with 0
+    b->rng[lane] = (b->seed ^ (lane * 0x9E3779B9u)) | 1;
+
+    if (b->fault[lane]) {
+        b->fault[lane] = false;
+        b->faulted--;
+        lane_shard(b, lane)->halted--;
+    }
+
+    memcpy(LANE_RAM(b, lane), b->image, RAM_SIZE);
+    b->written[lane] = 0;
+    memset(&b->display[(size_t) lane * BATCH_DISPLAY_ROWS], 0, BATCH_DISPLAY_ROWS * sizeof *b->display);
+}
+
+void batch_reset(chip8_batch_t *b, uint32_t seed) {
+    b->seed = seed;
+
+    for (uint32_t l = 0; l < b->lanes; l++) batch_reset_lane(b, l);
+
+    for (uint32_t s = 0; s < b->shard_count; s++) b->shards[s].written = 0;
+}
+
+static uint8_t lane_rand(chip8_batch_t *b, uint32_t lane) {
+    uint32_t x = b->rng[lane];
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    b->rng[lane] = x;
+
+    return x >> 24;
+}
+
+static void mark_written(chip8_batch_t *b, batch_shard_t *s, uint32_t lane, uint32_t addr, uint32_t len) {
+    if (len == 0) return;
+
+    for (uint32_t k = addr >> BLOCK_SHIFT; k <= (addr + len - 1) >> BLOCK_SHIFT; k++)
+        b->written[lane] |= 1ull << k;
+
+    s->written |= b->written[lane];
+}
+
+// halts a lane with PC left on the faulting instruction, as execute_instruction() does
+static void lane_fault(chip8_batch_t *b, batch_shard_t *s, uint32_t lane, uint16_t pc) {
+    b->PC[lane] = pc;
+    b->fault[lane] = true;
+    s->halted++;
+}
+
+/* Steps the lanes of [lo, hi) at address at through one opcode, with no
+ * per lane branching. Returns false, before touching any lane, for opcodes
+ * that need the per lane path, which are all the ones that can fault. Each loop body keeps the same order as
+ * execute_instruction() so that X or Y being F behaves identically.
+ */
+static bool exec_group(chip8_batch_t *b, uint16_t at, uint16_t opcode, uint8_t *restrict done,
+                       uint32_t lo, uint32_t hi) {
+    const uint16_t NNN = opcode & 0x0FFF;
+    const uint8_t NN = opcode & 0x0FF;
+    const uint8_t N = opcode & 0x0F;
+    uint8_t *vx = REG(b, (opcode >> 8) & 0x0F);
+    uint8_t *vy = REG(b, (opcode >> 4) & 0x0F);
+    uint8_t *vf = REG(b, 0xF);
+    uint16_t *restrict pc = b->PC;
+    uint16_t *I = b->I;
+    uint8_t *dt = b->delay_timer;
+    uint8_t *st = b->sound_timer;
+    const uint16_t *keys = b->keys;
+
+    switch ((opcode >> 12) & 0x0F) {
+        case 0x01:
+            FOR_LANES(pc[l] = m ? NNN : pc[l]);
+            return true;
+
+        case 0x03:
+            FOR_LANES(pc[l] += (m & (vx[l] == NN)) << 1);
+            return true;
+
+        case 0x04:
+            FOR_LANES(pc[l] += (m & (vx[l] != NN)) << 1);
+            return true;
+
+        case 0x05:
+            FOR_LANES(pc[l] += (m & (vx[l] == vy[l])) << 1);
+            return true;
+
+        case 0x06:
+            FOR_LANES(vx[l] = m ? NN : vx[l]);
+            return true;
+
+        case 0x07:
+            FOR_LANES(vx[l] += m ? NN : 0);
+            return true;
+
+        case 0x08:
+            /* registers are loaded before the select so the loop has no
+             * branches. VF written by an op on VF itself is read back in
+             * execute_instruction(), those run per lane.
+             */
+            if (N >= 4 && (vx == vf || vy == vf)) return false;
+
+            switch (N) {
+                case 0:
+                    FOR_LANES(const uint8_t x = vx[l], y = vy[l]; vx[l] = m ? y : x);
+                    return true;
+
+                case 1:
+                    FOR_LANES(const uint8_t x = vx[l], y = vy[l]; vx[l] = m ? x | y : x);
+                    return true;
+
+                case 2:
+                    FOR_LANES(const uint8_t x = vx[l], y = vy[l]; vx[l] = m ? x & y : x);
+                    return true;
+
+                case 3:
+                    FOR_LANES(const uint8_t x = vx[l], y = vy[l]; vx[l] = m ? x ^ y : x);
+                    return true;
+
+                case 4:
+                    // carry only ever sets VF, as in execute_instruction()
+                    FOR_LANES(
+                        const uint8_t x = vx[l], sum = x + vy[l], f = vf[l];
+                        vf[l] = m & (sum < x) ? 1 : f;
+                        vx[l] = m ? sum : x
+                    );
+                    return true;
+
+                case 5:
+                    FOR_LANES(
+                        const uint8_t x = vx[l], y = vy[l], f = vf[l];
+                        vf[l] = m ? x >= y : f;
+                        vx[l] = m ? x - y : x
+                    );
+                    return true;
+
+                case 6:
+                    FOR_LANES(
+                        const uint8_t x = vx[l], f = vf[l];
+                        vf[l] = m ? x & 1 : f;
+                        vx[l] = m ? x >> 1 : x
+                    );
+                    return true;
+
+                case 7:
+                    FOR_LANES(
+                        const uint8_t x = vx[l], y = vy[l], f = vf[l];
+                        vf[l] = m ? y >= x : f;
+                        vx[l] = m ? y - x : x
+                    );
+                    return true;
+
+                case 0xE:
+                    FOR_LANES(
+                        const uint8_t x = vx[l], f = vf[l];
+                        vf[l] = m ? x >> 7 : f;
+                        vx[l] = m ? x << 1 : x
+                    );
+                    return true;
+
+                default:
+                    FOR_LANES((void) 0);
+                    return true;
+            }
+
+        case 0x09:
+            FOR_LANES(pc[l] += (m & (vx[l] != vy[l])) << 1);
+            return true;
+
+        case 0x0A:
+            FOR_LANES(I[l] = m ? NNN : I[l]);
+            return true;
+
+        case 0x0E: {
+            // a key above F faults, whatever NN is, leave the whole group to the per lane path
+            uint8_t bad = 0;
+            for (uint32_t l = lo; l < hi; l++) bad |= SELECTED(l) & (vx[l] > 0xF);
+            if (bad) return false;
+
+            if (NN != 0x9E && NN != 0xA1) {
+                FOR_LANES((void) 0);
+                return true;
+            }
+
+            /* a shift by a per lane amount does not vectorize, 1 << VX is built
+             * as a product of one factor per bit of VX instead
+             */
+            const uint8_t pressed = NN == 0x9E;
+            FOR_LANES(
+                const uint16_t x = vx[l];
+                const uint16_t bit = (1 + (x & 1)) * (1 + 3 * (x >> 1 & 1)) *
+                                     (1 + 15 * (x >> 2 & 1)) * (1 + 255 * (x >> 3 & 1));
+                pc[l] += (m & (((keys[l] & bit) != 0) == pressed)) << 1
+            );
+            return true;
+        }
+
+        case 0x0F:
+            switch (NN) {
+                case 0x07:
+                    FOR_LANES(const uint8_t x = vx[l], t = dt[l]; vx[l] = m ? t : x);
+                    return true;
+
+                case 0x15:
+                    FOR_LANES(const uint8_t x = vx[l], t = dt[l]; dt[l] = m ? x : t);
+                    return true;
+
+                case 0x18:
+                    FOR_LANES(const uint8_t x = vx[l], t = st[l]; st[l] = m ? x : t);
+                    return true;
+
+                case 0x1E:
+                    FOR_LANES(const uint8_t x = vx[l]; I[l] += m ? x : 0);
+                    return true;
+
+                case 0x29:
+                    FOR_LANES(const uint8_t x = vx[l]; const uint16_t i = I[l]; I[l] = m ? x * 5 : i);
+                    return true;
+
+                default:
+                    return false;
+            }
+
+        default:
+            return false;
+    }
+}
+
+// single lane interpreter, mirrors execute_instruction() and its hazard checks
+static void exec_lane(chip8_batch_t *b, batch_shard_t *s, uint32_t l, uint16_t opcode) {
+    const uint32_t n = b->lanes;
+    const uint16_t NNN = opcode & 0x0FFF;
+    const uint8_t NN = opcode & 0x0FF;
+    const uint8_t N = opcode & 0x0F;
+    const uint8_t X = (opcode >> 8) & 0x0F;
+    const uint8_t Y = (opcode >> 4) & 0x0F;
+    const uint16_t pc = b->PC[l] - 2;
+    uint8_t *ram = LANE_RAM(b, l);
+    uint8_t *V = &b->V[l];      // V[r * n]
+    uint16_t *I = &b->I[l];
+
+    switch ((opcode >> 12) & 0x0F) {
+        case 0x0:
+            if (NN == 0xE0) {
+                memset(&b->display[(size_t) l * BATCH_DISPLAY_ROWS], 0, BATCH_DISPLAY_ROWS * sizeof *b->display);
+            }
+            else if (NN == 0xEE) {
+                if (b->SP[l] == 0) {
+                    lane_fault(b, s, l, pc);
+                    return;
+                }
+                b->PC[l] = b->stack[--b->SP[l] * n + l];
+            }
+            return;
+
+        case 0x02:
+            if (b->SP[l] == BATCH_STACK_SIZE) {
+                lane_fault(b, s, l, pc);
+                return;
+            }
+            b->stack[b->SP[l]++ * n + l] = b->PC[l];
+            b->PC[l] = NNN;
+            return;
+
+        case 0x0B:
+            b->PC[l] = V[0] + NNN;
+            return;
+
+        case 0x0C:
+            V[X * n] = lane_rand(b, l) & NN;
+            return;
+
+        case 0x0D: {
+            if (*I + N > RAM_SIZE) {
+                lane_fault(b, s, l, pc);
+                return;
+            }
+
+            const uint8_t x = V[X * n] % 64;
+            uint8_t y = V[Y * n] % BATCH_DISPLAY_ROWS;
+            uint64_t *rows = &b->display[(size_t) l * BATCH_DISPLAY_ROWS];
+
+            V[0xF * n] = 0;
+
+            // sprites are clipped at the right and bottom edges
+            for (uint8_t i = 0; i < N && y < BATCH_DISPLAY_ROWS; i++, y++) {
+                const uint64_t bits = ((uint64_t) READ_RAM(b, l, *I + i) << 56) >> x;
+
+                if (rows[y] & bits) V[0xF * n] = 1;
+                rows[y] ^= bits;
+            }
+            return;
+        }
+
+        case 0x0E:
+            if (V[X * n] > 0xF) {
+                lane_fault(b, s, l, pc);
+                return;
+            }
+
+            if (NN == 0x9E) {
+                if (b->keys[l] & (1u << V[X * n])) b->PC[l] += 2;
+            }
+            else if (NN == 0xA1) {
+                if (!(b->keys[l] & (1u << V[X * n]))) b->PC[l] += 2;
+            }
+            return;
+
+        case 0x0F:
+            switch (NN) {
+                case 0x07:
+                    V[X * n] = b->delay_timer[l];
+                    return;
+
+                case 0x0A:
+                    // halt until a key is held, then store the lowest one
+                    if (b->keys[l] == 0) {
+                        b->PC[l] -= 2;
+                        return;
+                    }
+                    V[X * n] = __builtin_ctz(b->keys[l]);
+                    return;
+
+                case 0x15:
+                    b->delay_timer[l] = V[X * n];
+                    return;
+
+                case 0x18:
+                    b->sound_timer[l] = V[X * n];
+                    return;
+
+                case 0x1E:
+                    *I += V[X * n];
+                    return;
+
+                case 0x29:
+                    *I = V[X * n] * 5;
+                    return;
+
+                case 0x33:
+                    if (*I + 3 > RAM_SIZE) {
+                        lane_fault(b, s, l, pc);
+                        return;
+                    }
+                    mark_written(b, s, l, *I, 3);
+                    ram[*I]     = (V[X * n] % 1000) / 100;
+                    ram[*I + 1] = (V[X * n] % 100) / 10;
+                    ram[*I + 2] = (V[X * n] % 10);
+                    return;
+
+                case 0x55:
+                    if (*I + X + 1 > RAM_SIZE) {
+                        lane_fault(b, s, l, pc);
+                        return;
+                    }
+                    mark_written(b, s, l, *I, X + 1);
+                    for (uint8_t i = 0; i <= X; i++)
+                        ram[*I + i] = V[i * n];
+                    return;
+
+                case 0x65:
+                    if (*I + X + 1 > RAM_SIZE) {
+                        lane_fault(b, s, l, pc);
+                        return;
+                    }
+                    for (uint8_t i = 0; i <= X; i++)
+                        V[i * n] = READ_RAM(b, l, *I + i);
+                    return;
+
+                default:
+                    return;
+            }
+
+        case 0x01:
+            b->PC[l] = NNN;
+            return;
+
+        case 0x03:
+            if (V[X * n] == NN) b->PC[l] += 2;
+            return;
+
+        case 0x04:
+            if (V[X * n] != NN) b->PC[l] += 2;
+            return;
+
+        case 0x05:
+            if (V[X * n] == V[Y * n]) b->PC[l] += 2;
+            return;
+
+        case 0x06:
+            V[X * n] = NN;
+            return;
+
+        case 0x07:
+            V[X * n] += NN;
+            return;
+
+        case 0x08:
+            switch (N) {
+                case 0: V[X * n] = V[Y * n]; return;
+                case 1: V[X * n] |= V[Y * n]; return;
+                case 2: V[X * n] &= V[Y * n]; return;
+                case 3: V[X * n] ^= V[Y * n]; return;
+
+                case 4:
+                    if (V[X * n] + V[Y * n] > 255) V[0xF * n] = 1;
+                    V[X * n] += V[Y * n];
+                    return;
+
+                case 5:
+                    V[0xF * n] = V[X * n] >= V[Y * n];
+                    V[X * n] -= V[Y * n];
+                    return;
+
+                case 6:
+                    V[0xF * n] = V[X * n] & 1;
+                    V[X * n] >>= 1;
+                    return;
+
+                case 7:
+                    V[0xF * n] = V[Y * n] >= V[X * n];
+                    V[X * n] = V[Y * n] - V[X * n];
+                    return;
+
+                case 0xE:
+                    V[0xF * n] = (V[X * n] & 0x80) >> 7;
+                    V[X * n] <<= 1;
+                    return;
+
+                default:
+                    return;
+            }
+
+        case 0x09:
+            if (V[X * n] != V[Y * n]) b->PC[l] += 2;
+            return;
+
+        case 0x0A:
+            *I = NNN;
+            return;
+
+        default:
+            return;
+    }
+}
+
+// lists the lanes at pc not stepped yet and moves them past the instruction
+static uint32_t select_pc(uint16_t *restrict PC, uint8_t *restrict done, uint8_t *restrict sel,
+                          uint32_t *restrict list, uint16_t pc, uint32_t lo, uint32_t hi) {
+    uint32_t count = 0;
+
+    for (uint32_t l = lo; l < hi; l++) {
+        const uint8_t m = (PC[l] == pc) & (done[l] ^ 1);
+        sel[l] = m;
+        done[l] |= m;
+        PC[l] += m << 1;
+    }
+
+    // eight lanes at a time, most words are empty; sel is zero past hi
+    for (uint32_t l = lo; l < hi; l += 8) {
+        uint64_t word;
+        memcpy(&word, &sel[l], sizeof word);
+
+        for (; word; word &= word - 1) list[count++] = l + __builtin_ctzll(word) / 8;
+    }
+
+    return count;
+}
+
+/* Lanes are grouped by PC: each pass takes the PC of the first lane not
+ * yet stepped, selects every lane at that PC with one vector compare and
+ * runs the opcode there as one masked loop. Lanes that stay together cost
+ * a single pass, lanes that diverged cost a pass per distinct PC rather
+ * than a dispatch per lane. Only blocks some lane of the shard stored to
+ * are fetched per lane, as are all lanes left once BATCH_MAX_GROUPS PCs
+ * were run.
+ */
+static void step_shard(chip8_batch_t *b, batch_shard_t *s) {
+    uint16_t *PC = b->PC;
+    const uint8_t *halted = (const uint8_t *) b->fault;
+    uint8_t *done = s->done - s->lo;
+    uint8_t *sel = s->sel - s->lo;
+    const uint32_t lo = s->lo, hi = s->hi;
+    uint32_t first = lo;
+    uint8_t out_of_range = 0;
+
+    for (uint32_t l = lo; l < hi; l++) {
+        done[l] = halted[l];
+        out_of_range |= (halted[l] ^ 1) & (PC[l] > RAM_SIZE - 2);
+    }
+
+    // PC past the end of ram is rare and faulted before grouping
+    if (out_of_range) {
+        for (uint32_t l = lo; l < hi; l++) {
+            if (!done[l] && PC[l] > RAM_SIZE - 2) {
+                lane_fault(b, s, l, PC[l]);
+                done[l] = 1;
+            }
+        }
+    }
+
+    for (uint32_t g = 0; g < BATCH_MAX_GROUPS; g++) {
+        const uint8_t *next = memchr(&done[first], 0, hi - first);
+        if (!next) return;
+        first = next - done;
+
+        const uint16_t pc = PC[first];
+        const uint16_t opcode = b->image[pc] << 8 | b->image[pc + 1];
+        const bool patched = s->written >> (pc >> BLOCK_SHIFT) & 1;
+
+        if (!patched && exec_group(b, pc, opcode, done, first, hi)) continue;
+
+        const uint32_t count = select_pc(PC, done, sel, s->list, pc, first, hi);
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t l = s->list[i];
+
+            exec_lane(b, s, l, patched ? READ_RAM(b, l, pc) << 8 | READ_RAM(b, l, pc + 1) : opcode);
+        }
+    }
+
+    for (uint32_t l = first; l < hi; l++) {
+        if (done[l]) continue;
+
+        const uint16_t pc = PC[l];
+        PC[l] += 2;
+        exec_lane(b, s, l, READ_RAM(b, l, pc) << 8 | READ_RAM(b, l, pc + 1));
+    }
+}
+
+static void run_shard(chip8_batch_t *b, batch_shard_t *s) {
+    for (uint32_t i = 0; i < b->instr_per_frame; i++) step_shard(b, s);
+
+    const uint8_t *halted = (const uint8_t *) b->fault;
+    uint8_t *dt = b->delay_timer;
+    uint8_t *st = b->sound_timer;
+    const uint32_t lo = s->lo, hi = s->hi;
+
+    for (uint32_t l = lo; l < hi; l++) {
+        const uint8_t run = halted[l] ^ 1;
+
+        dt[l] -= run & (dt[l] > 0);
+        st[l] -= run & (st[l] > 0);
+    }
+}
+
+static void *shard_thread(void *arg) {
+    batch_shard_t *s = arg;
+    chip8_batch_t *b = s->batch;
+
+    pthread_mutex_lock(&b->lock);
+    for (;;) {
+        while (b->generation == s->generation && !b->quit) pthread_cond_wait(&b->wake, &b->lock);
+        if (b->quit) break;
+        s->generation = b->generation;
+        pthread_mutex_unlock(&b->lock);
+
+        run_shard(b, s);
+
+        pthread_mutex_lock(&b->lock);
+        if (--b->pending == 0) pthread_cond_signal(&b->idle);
+    }
+    pthread_mutex_unlock(&b->lock);
+
+    return NULL;
+}
+
+bool batch_set_threads(chip8_batch_t *b, uint32_t threads) {
+    stop_threads(b);
+    free_shards(b);
+
+    if (threads == 0) threads = 1;
+
+    // shards cover whole cache lines of lanes so no two threads write the same line
+    uint32_t per_shard = (b->lanes + threads - 1) / threads;
+    per_shard = (per_shard + SHARD_ALIGN - 1) / SHARD_ALIGN * SHARD_ALIGN;
+
+    const uint32_t count = (b->lanes + per_shard - 1) / per_shard;
+
+    b->shards = calloc(count, sizeof *b->shards);
+    if (!b->shards) return false;
+    b->shard_count = count;
+
+    for (uint32_t i = 0; i < count; i++) {
+        batch_shard_t *s = &b->shards[i];
+
+        s->batch = b;
+        s->lo = i * per_shard;
+        s->hi = s->lo + per_shard < b->lanes ? s->lo + per_shard : b->lanes;
+        s->generation = b->generation;     // frames stepped before re-sharding are not this thread's to run
+        s->done = malloc(s->hi - s->lo);
+        s->sel = calloc(s->hi - s->lo + 8, sizeof *s->sel);
+        s->list = malloc((s->hi - s->lo) * sizeof *s->list);
+        if (!s->done || !s->sel || !s->list) {
+            free_shards(b);
+            return false;
+        }
+
+        for (uint32_t l = s->lo; l < s->hi; l++) {
+            s->halted += b->fault[l];
+            s->written |= b->written[l];
+        }
+    }
+
+    if (count == 1) return true;
+
+    b->threads = calloc(count, sizeof *b->threads);
+    if (!b->threads) {
+        batch_set_threads(b, 1);
+        return false;
+    }
+
+    for (uint32_t i = 1; i < count; i++) {
+        if (pthread_create(&b->threads[i], NULL, shard_thread, &b->shards[i]) != 0) {
+            // join the ones already running, then fall back to one thread
+            b->shard_count = i;
+            stop_threads(b);
+            b->shard_count = count;
+            batch_set_threads(b, 1);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void batch_step(chip8_batch_t *b, const uint16_t *actions, float *rewards, bool *dones) {
+    const uint32_t n = b->lanes;
+
+    if (actions) memcpy(b->keys, actions, n * sizeof *b->keys);
+
+    if (b->threads) {
+        pthread_mutex_lock(&b->lock);
+        b->pending = b->shard_count - 1;
+        b->generation++;
+        pthread_cond_broadcast(&b->wake);
+        pthread_mutex_unlock(&b->lock);
+    }
+
+    run_shard(b, &b->shards[0]);
+
+    if (b->threads) {
+        pthread_mutex_lock(&b->lock);
+        while (b->pending) pthread_cond_wait(&b->idle, &b->lock);
+        pthread_mutex_unlock(&b->lock);
+    }
+
+    b->faulted = 0;
+    for (uint32_t s = 0; s < b->shard_count; s++) b->faulted += b->shards[s].halted;
+
+    for (uint32_t l = 0; l < n; l++) {
+        bool done = b->fault[l];
+        float reward = 0.0f;
+
+        if (b->reward_fn) {
+            uint8_t V[16];
+            for (uint32_t r = 0; r < 16; r++) V[r] = b->V[r * n + l];
+
+            reward = b->reward_fn(LANE_RAM(b, l), V, &done, b->reward_userdata);
+        }
+
+        if (rewards) rewards[l] = reward;
+        if (dones) dones[l] = done;
+    }
+}
+
+void batch_observe(const chip8_batch_t *b, uint64_t *frames) {
+    memcpy(frames, b->display, (size_t) b->lanes * BATCH_DISPLAY_ROWS * sizeof *b->display);
+}
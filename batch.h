@@ -0,0 +1,96 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/* Lockstep engine running many chip8 machines at once for training agents.
+ * State is kept as struct-of-arrays. Each instruction step groups lanes by
+ * PC and runs every group as one masked, vectorized loop over the shard,
+ * so lanes that took different paths still share the fetch and decode.
+ * Lanes are split into shards that step a whole frame on their own threads.
+ * Needs no SDL, everything runs headless.
+ */
+
+#define BATCH_STACK_SIZE 12
+#define BATCH_DISPLAY_ROWS 32   // one uint64_t per row, bit 63 is x = 0
+#define BATCH_RAM_STRIDE (0x1000 + 64)  // padded so the same address in every lane does not share a cache set
+
+#define BATCH_MAX_GROUPS 64     // distinct PCs run as masked loops per step, the rest run one lane at a time
+
+// lanes [lo, hi) stepped by one thread
+typedef struct {
+    struct chip8_batch *batch;
+    uint32_t lo, hi;
+    uint32_t halted;            // faulted lanes in the shard
+    uint64_t written;           // blocks any lane of the shard stored to, kept until batch_reset()
+    uint64_t generation;        // frames its thread has run, starts at the batch's count when sharded
+    uint8_t *done;              // lanes already stepped this step, scratch
+    uint8_t *sel;               // lanes at the PC being stepped one at a time, scratch
+    uint32_t *list;             // the same lanes as indices, scratch
+} batch_shard_t;
+
+// called per lane after each step, returns the reward and may end the episode
+typedef float (*batch_reward_fn)(const uint8_t *ram, const uint8_t *V, bool *done, void *userdata);
+
+typedef struct chip8_batch {
+    uint32_t lanes;
+    uint32_t instr_per_frame;
+
+    // SoA registers, index as V[reg * lanes + lane]
+    uint8_t *V;
+    uint16_t *PC;
+    uint16_t *I;
+    uint8_t *SP;
+    uint16_t *stack;            // stack[depth * lanes + lane]
+    uint8_t *delay_timer;
+    uint8_t *sound_timer;
+    uint16_t *keys;             // keypad bitmask, bit k is key k
+    uint32_t *rng;              // per lane xorshift state, keeps runs reproducible
+    bool *fault;                // lane hit a stack, memory, PC or key hazard and is halted
+    uint32_t faulted;
+
+    uint8_t *ram;               // ram[lane * BATCH_RAM_STRIDE + addr]
+    uint64_t *written;          // per lane, bit k set once 64 byte block k of its ram was stored to
+    uint64_t *display;          // display[lane * BATCH_DISPLAY_ROWS + row]
+
+    uint8_t image[0x1000];      // font + rom copied into a lane on reset
+    uint32_t seed;
+
+    // one shard per thread, the caller's thread steps the first one
+    batch_shard_t *shards;
+    uint32_t shard_count;
+    pthread_t *threads;         // threads[s] steps shards[s], s >= 1
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        // a new frame was started
+    pthread_cond_t idle;        // the last shard of the frame finished
+    uint64_t generation;        // frames started
+    uint32_t pending;           // shard threads still running the frame
+    bool quit;
+
+    batch_reward_fn reward_fn;
+    void *reward_userdata;
+} chip8_batch_t;
+
+chip8_batch_t *batch_create(uint32_t lanes, const uint8_t *rom, size_t rom_size, uint32_t instr_per_frame);
+
+void batch_destroy(chip8_batch_t *b);
+
+// splits the lanes over this many threads, 1 steps everything on the caller's thread
+bool batch_set_threads(chip8_batch_t *b, uint32_t threads);
+
+void batch_set_reward_hook(chip8_batch_t *b, batch_reward_fn fn, void *userdata);
+
+void batch_reset(chip8_batch_t *b, uint32_t seed);
+
+void batch_reset_lane(chip8_batch_t *b, uint32_t lane);
+
+// actions[lane] is the keypad bitmask held for this step, rewards and dones may be NULL
+void batch_step(chip8_batch_t *b, const uint16_t *actions, float *rewards, bool *dones);
+
+// copies lanes * BATCH_DISPLAY_ROWS packed rows into frames
+void batch_observe(const chip8_batch_t *b, uint64_t *frames);
+
+#endif
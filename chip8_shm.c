@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "chip8_shm.h"
+
+#define SHM_OPEN_TRIES 100      // 1 ms apart, for a writer still sizing the segment
+
+/* A segment left behind by a writer that died is only reused when it is
+ * ours: same user, a chip8 header and an owner pid that no longer runs.
+ * Anything else under the name is left alone.
+ */
+static bool shm_stale(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_uid != geteuid() || (size_t) st.st_size != sizeof(chip8_shm_t)) {
+        close(fd);
+        return false;
+    }
+
+    const chip8_shm_t *shm = mmap(NULL, sizeof(chip8_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) return false;
+
+    const bool stale = shm->magic == CHIP8_SHM_MAGIC && shm->version == CHIP8_SHM_VERSION &&
+                       shm->owner > 0 && kill(shm->owner, 0) != 0 && errno == ESRCH;
+    munmap((void *) shm, sizeof(chip8_shm_t));
+
+    return stale;
+}
+
+chip8_shm_t *chip8_shm_create(const char *name) {
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST && shm_stale(name)) {
+        fprintf(stderr, "Removing stale shared memory %s\n", name);
+        shm_unlink(name);
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd < 0) {
+        if (errno == EEXIST)
+            fprintf(stderr, "Shared memory %s is in use by another process, pick another name\n", name);
+        else
+            fprintf(stderr, "Could not create shared memory %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+
+    if (ftruncate(fd, sizeof(chip8_shm_t)) != 0) {
+        fprintf(stderr, "Could not size shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    chip8_shm_t *shm = mmap(NULL, sizeof(chip8_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        fprintf(stderr, "Could not map shared memory %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+
+    // the segment is new, but keep seq odd until the header is valid for readers racing the open
+    atomic_store_explicit(&shm->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memset((uint8_t *) shm + offsetof(chip8_shm_t, frame), 0, sizeof(chip8_shm_t) - offsetof(chip8_shm_t, frame));
+    shm->magic = CHIP8_SHM_MAGIC;
+    shm->version = CHIP8_SHM_VERSION;
+    shm->owner = getpid();
+    atomic_store_explicit(&shm->seq, 2, memory_order_release);
+
+    return shm;
+}
+
+void chip8_shm_write_begin(chip8_shm_t *shm) {
+    const uint32_t seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void chip8_shm_write_end(chip8_shm_t *shm) {
+    const uint32_t seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&shm->seq, seq + 1, memory_order_release);
+}
+
+void chip8_shm_destroy(chip8_shm_t *shm, const char *name) {
+    munmap(shm, sizeof(chip8_shm_t));
+    shm_unlink(name);
+}
+
+/* The writer sizes the segment right after creating it, a reader racing
+ * the two sees an empty object and waits a moment. Mapping a segment of
+ * any other size would fault on the first access past its end.
+ */
+static bool shm_sized(int fd) {
+    struct stat st;
+
+    for (uint32_t tries = 0; tries < SHM_OPEN_TRIES; tries++) {
+        if (fstat(fd, &st) != 0) return false;
+        if (st.st_size != 0) return (size_t) st.st_size == sizeof(chip8_shm_t);
+        usleep(1000);
+    }
+
+    return false;
+}
+
+const chip8_shm_t *chip8_shm_open(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open shared memory %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+
+    if (!shm_sized(fd)) {
+        fprintf(stderr, "Shared memory %s is not a chip8 v%d segment\n", name, CHIP8_SHM_VERSION);
+        close(fd);
+        return NULL;
+    }
+
+    const chip8_shm_t *shm = mmap(NULL, sizeof(chip8_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        fprintf(stderr, "Could not map shared memory %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+
+    // wait out a writer that is still initialising the header
+    uint32_t seq;
+    do {
+        seq = chip8_shm_read_begin(shm);
+    } while (chip8_shm_read_retry(shm, seq));
+
+    if (shm->magic != CHIP8_SHM_MAGIC || shm->version != CHIP8_SHM_VERSION) {
+        fprintf(stderr, "Shared memory %s is not a chip8 v%d segment\n", name, CHIP8_SHM_VERSION);
+        chip8_shm_close(shm);
+        return NULL;
+    }
+
+    return shm;
+}
+
+void chip8_shm_close(const chip8_shm_t *shm) {
+    munmap((void *) shm, sizeof(chip8_shm_t));
+}
+
+uint32_t chip8_shm_read_begin(const chip8_shm_t *shm) {
+    _Atomic uint32_t *seq_ptr = (_Atomic uint32_t *) &shm->seq;
+    uint32_t seq;
+
+    // spin while the writer is mid frame
+    while ((seq = atomic_load_explicit(seq_ptr, memory_order_acquire)) & 1)
+        ;
+
+    return seq;
+}
+
+bool chip8_shm_read_retry(const chip8_shm_t *shm, uint32_t seq) {
+    atomic_thread_fence(memory_order_acquire);
+
+    return atomic_load_explicit((_Atomic uint32_t *) &shm->seq, memory_order_relaxed) != seq;
+}
+
+void chip8_shm_read(const chip8_shm_t *shm, chip8_shm_t *out) {
+    uint32_t seq;
+
+    do {
+        seq = chip8_shm_read_begin(shm);
+        memcpy(out, shm, sizeof *out);
+    } while (chip8_shm_read_retry(shm, seq));
+}
@@ -0,0 +1,63 @@
+#ifndef CHIP8_SHM_H
+#define CHIP8_SHM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* Live machine state published by the emulator into a POSIX shared memory
+ * segment (-pub /name). The emulator is the only writer and never waits on
+ * readers. Readers map the segment read-only and use the seqlock: seq is
+ * odd while a frame is being written, and a read is consistent when seq
+ * was even and unchanged on both sides of it.
+ *
+ *  uint32_t seq;
+ *  do {
+ *      seq = chip8_shm_read_begin(shm);
+ *      ... read fields straight from shm ...
+ *  } while (chip8_shm_read_retry(shm, seq));
+ */
+
+#define CHIP8_SHM_MAGIC 0x38504843  // "CHP8"
+#define CHIP8_SHM_VERSION 1
+
+#define CHIP8_SHM_DISPLAY_W 64
+#define CHIP8_SHM_DISPLAY_H 32
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    _Atomic uint32_t seq;
+    int32_t owner;              // pid of the writer, tells a stale segment from a live one
+
+    uint64_t frame;             // emulated frames (timer ticks) since load
+    uint8_t V[16];
+    uint16_t I;
+    uint16_t PC;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t display[CHIP8_SHM_DISPLAY_W * CHIP8_SHM_DISPLAY_H];    // one byte per pixel, 0 or 1
+} chip8_shm_t;
+
+// writer side, used by the emulator
+chip8_shm_t *chip8_shm_create(const char *name);
+
+void chip8_shm_write_begin(chip8_shm_t *shm);
+
+void chip8_shm_write_end(chip8_shm_t *shm);
+
+void chip8_shm_destroy(chip8_shm_t *shm, const char *name);
+
+// reader side
+const chip8_shm_t *chip8_shm_open(const char *name);
+
+void chip8_shm_close(const chip8_shm_t *shm);
+
+uint32_t chip8_shm_read_begin(const chip8_shm_t *shm);
+
+bool chip8_shm_read_retry(const chip8_shm_t *shm, uint32_t seq);
+
+// copies a consistent snapshot into out
+void chip8_shm_read(const chip8_shm_t *shm, chip8_shm_t *out);
+
+#endif
@@ -1,10 +1,31 @@
+#include <sys/stat.h>
 #include "emu.h"
-
+#include "telemetry.h"
+#include "font.h"
+#include "chip8_shm.h"
+#include "analyze.h"
+#include "romdb.h"
+#include "governor.h"
+
+#ifndef CHIP8_QUIET    // tools built on the core, like the fuzzer, turn off tracing
 #define DEBUG
+#endif
 
 config_t config = {0};
+config_t base_config = {0};
 sdl_t sdl = {0};
 chip8_t chip8 = {0};
+chip8_shm_t *shm = NULL;
+
+// path of the loaded rom and its stamp for the file watch
+static char rom_path_buf[4096];
+static struct timespec rom_mtime;
+static off_t rom_fsize;
+
+// control flow and idle loops of the loaded rom
+static rom_analysis_t analysis;
+static uint64_t rom_loaded_hash = 0;
+static bool rom_settings_saved = false;     // -dbsave stores once per load
 
 // SDL functions
 void audio_callback(void *userdata, uint8_t *stream, int len) {
@@ -23,6 +44,21 @@ void audio_callback(void *userdata, uint8_t *stream, int len) {
     }
 }
 
+static void update_window_title() {
+    char title[64];
+
+    if (!sdl.window) return;
+
+    if (chip8.fault != FAULT_NONE)
+        snprintf(title, sizeof title, "Chip8 Emu (stopped: %s)", fault_name(chip8.fault));
+    else if (chip8.fast_forward)
+        snprintf(title, sizeof title, "Chip8 Emu (x%u)", config.ff_multiplier);
+    else
+        snprintf(title, sizeof title, "Chip8 Emu");
+
+    SDL_SetWindowTitle(sdl.window, title);
+}
+
 bool sdl_init() {
     srand(time(NULL));
 
@@ -66,6 +102,8 @@ bool sdl_init() {
         return false;
     }
 
+    update_window_title();
+
     return true;
 }
 
@@ -106,6 +144,8 @@ bool update_screen() {
     const uint8_t fg_b = (config.fg_color >> 8) & 0xFF;
     const uint8_t fg_a = (config.fg_color >> 0) & 0xFF;
     
+    chip8.draw = false;
+
     // draw 
     for (uint32_t i = 0; i < sizeof chip8.display; i++) {
         // translate 1D index i value to 2D x, y coords
@@ -132,10 +172,22 @@ bool update_screen() {
         }
 
     }
+}
+
+void present_screen() {
+    if (config.stats_overlay)
+        telemetry_draw_overlay(sdl.renderer, config.window_w * config.scale, config.window_h * config.scale);
 
     SDL_RenderPresent(sdl.renderer);
 }
 
+// maps a host key to the chip8 keypad through config.keymap
+static void set_key(SDL_Keycode sym, bool pressed) {
+    for (uint8_t k = 0; k < sizeof(chip8.keypad); k++) {
+        if (config.keymap[k] == sym) chip8.keypad[k] = pressed;
+    }
+}
+
 void user_input() {
     SDL_Event event;
 
@@ -145,52 +197,51 @@ void user_input() {
                 chip8.state = QUIT;
                 break;
             
+            case SDL_DROPFILE:
+                // dropping a rom on the window swaps to it
+                chip8_load_rom(event.drop.file);
+                SDL_free(event.drop.file);
+                break;
+
             case SDL_KEYDOWN:
                 switch (event.key.keysym.sym) {
-                    case SDLK_1: chip8.keypad[0x1] = true; break; 
-                    case SDLK_2: chip8.keypad[0x2] = true; break; 
-                    case SDLK_3: chip8.keypad[0x3] = true; break; 
-                    case SDLK_4: chip8.keypad[0xC] = true; break; 
-
-                    case SDLK_q: chip8.keypad[0x4] = true; break; 
-                    case SDLK_w: chip8.keypad[0x5] = true; break; 
-                    case SDLK_e: chip8.keypad[0x6] = true; break; 
-                    case SDLK_r: chip8.keypad[0xD] = true; break; 
-
-                    case SDLK_a: chip8.keypad[0x7] = true; break; 
-                    case SDLK_s: chip8.keypad[0x8] = true; break; 
-                    case SDLK_d: chip8.keypad[0x9] = true; break; 
-                    case SDLK_f: chip8.keypad[0xE] = true; break; 
-
-                    case SDLK_z: chip8.keypad[0xA] = true; break; 
-                    case SDLK_x: chip8.keypad[0x0] = true; break; 
-                    case SDLK_c: chip8.keypad[0xB] = true; break; 
-                    case SDLK_v: chip8.keypad[0xF] = true; break;
+                    // fast-forward: toggle, then raise/lower the multiplier
+                    case SDLK_TAB:
+                        if (!event.key.repeat) {
+                            chip8.fast_forward = !chip8.fast_forward;
+                            update_window_title();
+                        }
+                        break;
+
+                    case SDLK_EQUALS:
+                        config.ff_multiplier *= 2;
+                        if (config.ff_multiplier > FF_MULTIPLIER_MAX) config.ff_multiplier = FF_MULTIPLIER_MAX;
+                        update_window_title();
+                        break;
+
+                    case SDLK_F5:
+                        // restart the current rom
+                        if (!event.key.repeat) chip8_load_rom(chip8.rom_path);
+                        break;
+
+                    case SDLK_F1:
+                        config.stats_overlay = !config.stats_overlay;
+                        break;
+
+                    case SDLK_MINUS:
+                        config.ff_multiplier /= 2;
+                        if (config.ff_multiplier < FF_MULTIPLIER_MIN) config.ff_multiplier = FF_MULTIPLIER_MIN;
+                        update_window_title();
+                        break;
+
+                    default:
+                        set_key(event.key.keysym.sym, true);
+                        break;
                 }
                 break;
 
             case SDL_KEYUP:
-                switch (event.key.keysym.sym) {
-                    case SDLK_1: chip8.keypad[0x1] = false; break; 
-                    case SDLK_2: chip8.keypad[0x2] = false; break; 
-                    case SDLK_3: chip8.keypad[0x3] = false; break; 
-                    case SDLK_4: chip8.keypad[0xC] = false; break; 
-
-                    case SDLK_q: chip8.keypad[0x4] = false; break; 
-                    case SDLK_w: chip8.keypad[0x5] = false; break; 
-                    case SDLK_e: chip8.keypad[0x6] = false; break; 
-                    case SDLK_r: chip8.keypad[0xD] = false; break; 
-
-                    case SDLK_a: chip8.keypad[0x7] = false; break; 
-                    case SDLK_s: chip8.keypad[0x8] = false; break; 
-                    case SDLK_d: chip8.keypad[0x9] = false; break; 
-                    case SDLK_f: chip8.keypad[0xE] = false; break; 
-
-                    case SDLK_z: chip8.keypad[0xA] = false; break; 
-                    case SDLK_x: chip8.keypad[0x0] = false; break; 
-                    case SDLK_c: chip8.keypad[0xB] = false; break; 
-                    case SDLK_v: chip8.keypad[0xF] = false; break;
-                }
+                set_key(event.key.keysym.sym, false);
                 break;
 
             default:
@@ -199,6 +250,36 @@ void user_input() {
     }
 }
 
+// export functions
+bool export_init() {
+    if (!config.shm_name) return true;
+
+    shm = chip8_shm_create(config.shm_name);
+    return shm != NULL;
+}
+
+// publishes the machine state for external readers, no syscalls involved
+void export_state() {
+    if (!shm) return;
+
+    chip8_shm_write_begin(shm);
+    shm->frame = chip8.frame;
+    memcpy(shm->V, chip8.V, sizeof(chip8.V));
+    shm->I = chip8.I;
+    shm->PC = chip8.PC;
+    shm->delay_timer = chip8.delay_timer;
+    shm->sound_timer = chip8.sound_timer;
+    memcpy(shm->display, chip8.display, sizeof(chip8.display));
+    chip8_shm_write_end(shm);
+}
+
+void export_quit() {
+    if (!shm) return;
+
+    chip8_shm_destroy(shm, config.shm_name);
+    shm = NULL;
+}
+
 // configuration functions
 bool config_init(int argc, char **argv) {
 
@@ -213,47 +294,155 @@ bool config_init(int argc, char **argv) {
         .instr_per_frame = 20,
         .square_wave_freq = 440,
         .volume = 3000,
+        .ff_multiplier = 4,
+        .keymap = {
+            SDLK_x, SDLK_1, SDLK_2, SDLK_3,     // 0 1 2 3
+            SDLK_q, SDLK_w, SDLK_e, SDLK_a,     // 4 5 6 7
+            SDLK_s, SDLK_d, SDLK_z, SDLK_c,     // 8 9 A B
+            SDLK_4, SDLK_r, SDLK_f, SDLK_v,     // C D E F
+        },
     };
 
-    for (int i = 1; i < argc; i++) {
-        if (strncmp(argv[i], "-po", strlen("-po"))      == 0) config.pixel_outlines = (bool) strtoul(argv[++i], NULL, 10);
-        if (strncmp(argv[i], "-s", strlen("-s"))        == 0) config.scale = (uint32_t) strtoul(argv[++i], NULL, 10);
-        if (strncmp(argv[i], "-ipf", strlen("-ipf"))    == 0) config.instr_per_frame = (uint32_t) strtoul(argv[++i], NULL, 10);
-        if (strncmp(argv[i], "-v", strlen("-v"))        == 0) config.volume = (int16_t) strtoul(argv[++i], NULL, 10);
+    // argv[1] is the rom, every flag after it takes one value
+    for (int i = 2; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            SDL_Log("Missing value for %s", argv[i]);
+            return false;
+        }
+
+        const char *flag = argv[i];
+        char *value = argv[i + 1];
+
+        if (strcmp(flag, "-po") == 0)           config.pixel_outlines = (bool) strtoul(value, NULL, 10);
+        else if (strcmp(flag, "-s") == 0)       config.scale = (uint32_t) strtoul(value, NULL, 10);
+        else if (strcmp(flag, "-v") == 0)       config.volume = (int16_t) strtoul(value, NULL, 10);
+        else if (strcmp(flag, "-gmin") == 0)    config.ipf_min = (uint32_t) strtoul(value, NULL, 10);
+        else if (strcmp(flag, "-gmax") == 0)    config.ipf_max = (uint32_t) strtoul(value, NULL, 10);
+        else if (strcmp(flag, "-w") == 0)       config.watch_rom = (bool) strtoul(value, NULL, 10);
+        else if (strcmp(flag, "-pub") == 0)     config.shm_name = value;
+        else if (strcmp(flag, "-ov") == 0)      config.stats_overlay = (bool) strtoul(value, NULL, 10);
+        else if (strcmp(flag, "-tm") == 0)      config.stats_path = value;
+        else if (strcmp(flag, "-db") == 0)      config.db_path = value;
+        else if (strcmp(flag, "-dbsave") == 0)  config.db_save = (bool) strtoul(value, NULL, 10);
+        // settings the rom database can also provide, the command line wins
+        else if (strcmp(flag, "-ipf") == 0) {
+            config.instr_per_frame = (uint32_t) strtoul(value, NULL, 10);
+            config.overrides |= ROMDB_IPF;
+        }
+        else if (strcmp(flag, "-q") == 0) {
+            config.quirks = (uint32_t) strtoul(value, NULL, 0);
+            config.overrides |= ROMDB_QUIRKS;
+        }
+        else if (strcmp(flag, "-fg") == 0 || strcmp(flag, "-bg") == 0) {
+            const uint32_t color = (uint32_t) strtoul(value, NULL, 16);
+            if (flag[1] == 'f') config.fg_color = color;
+            else config.bk_color = color;
+            config.overrides |= ROMDB_COLORS;
+        }
+        else if (strcmp(flag, "-ff") == 0) {
+            // start in fast-forward at the given speed multiplier
+            config.ff_multiplier = (uint32_t) strtoul(value, NULL, 10);
+            chip8.fast_forward = true;
+        }
+        else {
+            SDL_Log("Unknown flag: %s", flag);
+            return false;
+        }
     }
+    if (config.ff_multiplier < FF_MULTIPLIER_MIN) config.ff_multiplier = FF_MULTIPLIER_MIN;
+    if (config.ff_multiplier > FF_MULTIPLIER_MAX) config.ff_multiplier = FF_MULTIPLIER_MAX;
+
+    if (config.db_save && config.ipf_min == 0 && config.ipf_max == 0)
+        SDL_Log("-dbsave needs a governor range (-gmin/-gmax), nothing will be saved");
+
+    if (!config.db_path) config.db_path = (char *) romdb_default_path();
+    if (config.db_path && !romdb_load(config.db_path)) return false;
+
+    // what a rom without a database entry falls back to
+    base_config = config;
 
     return true;
 }
 
+// applies the database entry for a rom over the defaults, flags always win
+static void apply_rom_settings(uint64_t hash) {
+    const romdb_entry_t *entry = romdb_find(hash);
+    const uint32_t fields = entry ? entry->fields & ~config.overrides : 0;
+
+    config.instr_per_frame = fields & ROMDB_IPF ? entry->instr_per_frame : base_config.instr_per_frame;
+    config.quirks = fields & ROMDB_QUIRKS ? entry->quirks : base_config.quirks;
+    config.fg_color = fields & ROMDB_COLORS ? entry->fg_color : base_config.fg_color;
+    config.bk_color = fields & ROMDB_COLORS ? entry->bk_color : base_config.bk_color;
+
+    for (uint8_t k = 0; k < 0x10; k++)
+        config.keymap[k] = fields & ROMDB_KEYMAP ? entry->keymap[k] : base_config.keymap[k];
+
+    if ((fields & ROMDB_ENGINE) && entry->engine != ENGINE_INTERPRETER)
+        SDL_Log("Rom database asks for engine %u, only the interpreter is available", entry->engine);
+
+    if (entry) SDL_Log("Rom database: using settings for %016llx", (unsigned long long) hash);
+}
+
+/* -dbsave is a benchmark mode: the instructions per frame depend on the
+ * host, so they are only written once the governor held one budget for a
+ * while, and only once per load.
+ */
+void save_rom_settings() {
+    if (!config.db_save || rom_settings_saved || !governor_settled()) return;
+    if (!config.db_path || !rom_loaded_hash) return;
+
+    rom_settings_saved = true;
+
+    const romdb_entry_t entry = {
+        .hash = rom_loaded_hash,
+        .fields = ROMDB_IPF,
+        .instr_per_frame = governor_instr_per_frame(),
+    };
+
+    if (romdb_store(config.db_path, &entry))
+        SDL_Log("Rom database: saved %u instructions per frame for %016llx",
+                entry.instr_per_frame, (unsigned long long) rom_loaded_hash);
+}
+
 uint32_t get_instr_per_frame() {
     return config.instr_per_frame;
 }
 
+char *get_stats_path() {
+    return config.stats_path;
+}
+
+// number of emulated frames (instruction batch + timer tick) to run per host frame
+uint32_t get_frames_per_tick() {
+    return chip8.fast_forward ? config.ff_multiplier : 1;
+}
+
 // chip8 functions
-bool chip8_init(char *rom_path) {
-    const uint8_t font_set[] = {
-        0xF0, 0x90, 0x90, 0x90, 0xF0,		// 0
-	    0x20, 0x60, 0x20, 0x20, 0x70,		// 1
-	    0xF0, 0x10, 0xF0, 0x80, 0xF0,		// 2
-	    0xF0, 0x10, 0xF0, 0x10, 0xF0,		// 3
-	    0x90, 0x90, 0xF0, 0x10, 0x10,		// 4
-	    0xF0, 0x80, 0xF0, 0x10, 0xF0,		// 5
-	    0xF0, 0x80, 0xF0, 0x90, 0xF0,		// 6
-	    0xF0, 0x10, 0x20, 0x40, 0x40,		// 7
-	    0xF0, 0x90, 0xF0, 0x90, 0xF0,		// 8
-	    0xF0, 0x90, 0xF0, 0x10, 0xF0,		// 9
-	    0xF0, 0x90, 0xF0, 0x90, 0x90,		// A
-	    0xE0, 0x90, 0xE0, 0x90, 0xE0,		// B
-	    0xF0, 0x80, 0x80, 0x80, 0xF0,		// C
-	    0xE0, 0x90, 0x90, 0x90, 0xE0,		// D
-	    0xF0, 0x80, 0xF0, 0x80, 0xF0,		// E
-	    0xF0, 0x80, 0xF0, 0x80, 0x80		// F
-    };
-    
+// clears the whole machine in place, the loaded rom has to be copied in again
+void chip8_reset() {
+    // front end settings that live in chip8_t survive a reset
+    const bool fast_forward = chip8.fast_forward;
+    char *rom_path = chip8.rom_path;
+
+    memset(&chip8, 0, sizeof(chip8));
+
+    chip8.fast_forward = fast_forward;
+    chip8.rom_path = rom_path;
+
     // load font
     memcpy(&chip8.ram[0], &font_set, sizeof(font_set));
 
-    // load rom
+    chip8.state = RUNNING;
+    chip8.draw = true;
+    chip8.stack_ptr = &chip8.stack[0];
+    chip8.PC = 0x200;
+}
+
+// resets the machine and loads a rom, on failure the current game keeps running
+bool chip8_load_rom(char *rom_path) {
+    uint8_t rom[sizeof(chip8.ram) - 0x200];
+    struct stat rom_stat;
+
     FILE *rom_ptr = fopen(rom_path, "rb");
     if (!rom_ptr) {
         SDL_Log("Unable to open rom file: %s", rom_path);
@@ -264,31 +453,69 @@ bool chip8_init(char *rom_path) {
     printf("Loading ROM: %s\n", rom_path);
 #endif
 
-    // add some more error handling later
-    fseek(rom_ptr, 0, SEEK_END);
-    const size_t rom_size = ftell(rom_ptr);
-    rewind(rom_ptr);
+    if (fstat(fileno(rom_ptr), &rom_stat) != 0 || rom_stat.st_size == 0 ||
+        (size_t) rom_stat.st_size > sizeof(rom)) {
+        SDL_Log("Rom file is empty or does not fit in Ram: %s", rom_path);
+        fclose(rom_ptr);
+        return false;
+    }
+    const size_t rom_size = rom_stat.st_size;
 
 #ifdef DEBUG
     printf("ROM size: %zu bytes\n", rom_size);
 #endif
 
     // read rom
-    if (fread(&chip8.ram[0x200], rom_size, 1, rom_ptr) != 1) {
+    if (fread(rom, rom_size, 1, rom_ptr) != 1) {
         SDL_Log("Could not load Rom into Ram");
+        fclose(rom_ptr);
         return false;
     }
 
     fclose(rom_ptr);
 
-    chip8.state = RUNNING;
-    chip8.stack_ptr = &chip8.stack[0];
-    chip8.PC = 0x200;
-    chip8.rom_path = rom_path;
+    // rom_path may be the buffer itself when reloading
+    if (rom_path != rom_path_buf)
+        snprintf(rom_path_buf, sizeof(rom_path_buf), "%s", rom_path);
+    chip8.rom_path = rom_path_buf;
+    rom_mtime = rom_stat.st_mtim;
+    rom_fsize = rom_stat.st_size;
+
+    chip8_reset();
+    memcpy(&chip8.ram[0x200], rom, rom_size);
+
+    analyze_rom_cached(rom, rom_size, &analysis);
+
+    rom_loaded_hash = rom_hash(rom, rom_size);
+    rom_settings_saved = false;
+    apply_rom_settings(rom_loaded_hash);
+    governor_init(config.instr_per_frame, config.ipf_min, config.ipf_max);
+    update_window_title();
 
     return true;
 }
 
+bool chip8_init(char *rom_path) {
+    return chip8_load_rom(rom_path);
+}
+
+// reloads the rom when the file changes on disk, polled from the main loop
+void watch_rom() {
+    static uint32_t last_check = 0;
+    struct stat rom_stat;
+
+    if (!config.watch_rom || SDL_GetTicks() - last_check < ROM_WATCH_INTERVAL_MS) return;
+    last_check = SDL_GetTicks();
+
+    if (stat(chip8.rom_path, &rom_stat) != 0) return;
+
+    if (rom_stat.st_mtim.tv_sec != rom_mtime.tv_sec || rom_stat.st_mtim.tv_nsec != rom_mtime.tv_nsec ||
+        rom_stat.st_size != rom_fsize) {
+        SDL_Log("Rom changed on disk, reloading: %s", chip8.rom_path);
+        chip8_load_rom(chip8.rom_path);
+    }
+}
+
 
 #ifdef DEBUG
 void print_debug(instruction_t inst) {
@@ -437,7 +664,105 @@ void print_debug(instruction_t inst) {
 }
 #endif
 
+// returns the hazard inst would hit, checked before anything is touched
+static chip8_fault_t check_instruction(instruction_t inst) {
+    switch ((inst.opcode >> 12) & 0x0F) {
+        case 0x0:
+            if (inst.NN == 0xEE && chip8.stack_ptr == &chip8.stack[0]) return FAULT_STACK_UNDERFLOW;
+            break;
+
+        case 0x02:
+            if (chip8.stack_ptr == &chip8.stack[sizeof(chip8.stack) / sizeof(chip8.stack[0])]) return FAULT_STACK_OVERFLOW;
+            break;
+
+        case 0x0D:
+            if (chip8.I + inst.N > sizeof(chip8.ram)) return FAULT_RAM_OUT_OF_RANGE;
+            break;
+
+        case 0x0E:
+            if (chip8.V[inst.X] >= sizeof(chip8.keypad)) return FAULT_BAD_KEY;
+            break;
+
+        case 0x0F:
+            if (inst.NN == 0x33 && (size_t) chip8.I + 3 > sizeof(chip8.ram)) return FAULT_RAM_OUT_OF_RANGE;
+            if ((inst.NN == 0x55 || inst.NN == 0x65) && (size_t) chip8.I + inst.X + 1 > sizeof(chip8.ram)) return FAULT_RAM_OUT_OF_RANGE;
+            break;
+
+        default:
+            break;
+    }
+
+    return FAULT_NONE;
+}
+
+// pauses instead of quitting so a reload, F5 or a dropped rom can resume
+static void fault(chip8_fault_t fault) {
+    chip8.fault = fault;
+    chip8.state = PAUSE;
+    update_window_title();
+
+    // update_timers() no longer runs, silence a tone that was playing
+    if (sdl.dev) SDL_PauseAudioDevice(sdl.dev, 1);
+}
+
+/* Arriving at an idle loop head twice with the same registers, having run
+ * only idle opcodes in between, means the loop repeats unchanged until the
+ * timers or keys change at the next frame. Returns the length of the cycle
+ * in instructions once it repeated, 0 before.
+ */
+static uint32_t track_idle(uint32_t executed) {
+    const uint16_t pc = chip8.PC;
+    if (pc > sizeof(chip8.ram) - 2) return 0;
+
+    const uint16_t opcode = chip8.ram[pc] << 8 | chip8.ram[pc + 1];
+    if (!analysis.idle_body[pc] || !idle_opcode(opcode)) {
+        chip8.idle_head = 0;
+        return 0;
+    }
+
+    if (!analysis.idle_head[pc]) return 0;
+
+    if (chip8.idle_head == pc && memcmp(chip8.idle_V, chip8.V, sizeof(chip8.V)) == 0)
+        return executed - chip8.idle_at;
+
+    chip8.idle_head = pc;
+    chip8.idle_at = executed;
+    memcpy(chip8.idle_V, chip8.V, sizeof(chip8.V));
+    return 0;
+}
+
+/* Each whole cycle of an idle loop ends in the state it started from, so
+ * they are skipped and only the remainder runs, leaving the machine where
+ * running every instruction would have.
+ */
+uint32_t run_instructions(uint32_t count) {
+    uint32_t executed = 0;
+
+    chip8.idle_head = 0;
+
+    for (uint32_t i = 0; i < count && chip8.fault == FAULT_NONE; i++) {
+        const uint32_t cycle = track_idle(i);
+        if (cycle) {
+            i += (count - i) / cycle * cycle;
+            chip8.idle_head = 0;
+            if (i == count) break;
+        }
+
+        execute_instruction();
+        executed++;
+    }
+
+    return executed;
+}
+
 void execute_instruction() {
+    if (chip8.fault != FAULT_NONE) return;
+
+    if (chip8.PC > sizeof(chip8.ram) - 2) {
+        fault(FAULT_PC_OUT_OF_RANGE);
+        return;
+    }
+
     instruction_t inst;
     inst.opcode = chip8.ram[chip8.PC] << 8 | chip8.ram[chip8.PC + 1];
     chip8.PC += 2;
@@ -448,6 +773,13 @@ void execute_instruction() {
     inst.X = (inst.opcode >> 8) & 0x0F;
     inst.Y = (inst.opcode >> 4) & 0x0F;
 
+    const chip8_fault_t hazard = check_instruction(inst);
+    if (hazard != FAULT_NONE) {
+        chip8.PC -= 2;  // leave PC on the faulting instruction
+        fault(hazard);
+        return;
+    }
+
 
 #ifdef DEBUG
     print_debug(inst);
@@ -458,6 +790,7 @@ void execute_instruction() {
             if (inst.NN == 0xE0) {
                 // clear display
                 memset(&chip8.display, false, sizeof(chip8.display));
+                chip8.draw = true;
             }
             else if (inst.NN == 0xEE) {
                 // returns from a subroutine
@@ -531,6 +864,7 @@ void execute_instruction() {
                
                case 6:
                    // shift Vx by 1 and store shifted bit in Vf
+                   if (config.quirks & QUIRK_SHIFT_VY) chip8.V[inst.X] = chip8.V[inst.Y];
                    chip8.V[0xF] = chip8.V[inst.X] & 1;
                    chip8.V[inst.X] >>= 1;
                    break;
@@ -547,6 +881,7 @@ void execute_instruction() {
                    break;
 
                case 0xE:
+                   if (config.quirks & QUIRK_SHIFT_VY) chip8.V[inst.X] = chip8.V[inst.Y];
                    chip8.V[0xF] = (chip8.V[inst.X] & 0x80) >> 7;
                    chip8.V[inst.X] <<= 1;
                    break;
@@ -586,6 +921,7 @@ void execute_instruction() {
             const uint8_t original_x = x;
             
             chip8.V[0xF] = 0;
+            chip8.draw = true;
 
             // loop N rows of the sprite
             for (uint8_t i = 0; i < inst.N; i++) {
@@ -682,14 +1018,16 @@ void execute_instruction() {
 
                 case 0x55:
                     // dumps V0-Vx included to memory from I
-                    for (uint8_t i = 0; i < inst.X; i++)
+                    for (uint8_t i = 0; i <= inst.X; i++)
                         chip8.ram[chip8.I + i] = chip8.V[i];
+                    if (config.quirks & QUIRK_MEMORY_I) chip8.I += inst.X + 1;
                     break;
 
                 case 0x65:
                     // load register V0-Vx included from memory starting at I
-                    for (uint8_t i = 0; i < inst.X; i++)
+                    for (uint8_t i = 0; i <= inst.X; i++)
                         chip8.V[i] = chip8.ram[chip8.I + i];
+                    if (config.quirks & QUIRK_MEMORY_I) chip8.I += inst.X + 1;
                     break;
 
                 default:
@@ -705,18 +1043,53 @@ void execute_instruction() {
 
 
 void update_timers() {
+    chip8.frame++;
+
     if (chip8.delay_timer > 0) chip8.delay_timer--;
 
     if (chip8.sound_timer > 0) {
         chip8.sound_timer--;
-        SDL_PauseAudioDevice(sdl.dev, 0); // play sound
+        // muted while fast-forwarding, the beeps would just be noise
+        if (sdl.dev) SDL_PauseAudioDevice(sdl.dev, chip8.fast_forward); // play sound
     }
     else {
-        SDL_PauseAudioDevice(sdl.dev, 1); // pause sound
+        if (sdl.dev) SDL_PauseAudioDevice(sdl.dev, 1); // pause sound
     }
 }
 
+bool screen_changed() {
+    return chip8.draw;
+}
+
 emu_state_t get_chip8_state() {
     return chip8.state;
 }
 
+chip8_fault_t get_chip8_fault() {
+    return chip8.fault;
+}
+
+const char *fault_name(chip8_fault_t fault) {
+    switch (fault) {
+        case FAULT_NONE:                return "none";
+        case FAULT_PC_OUT_OF_RANGE:     return "pc out of range";
+        case FAULT_STACK_OVERFLOW:      return "stack overflow";
+        case FAULT_STACK_UNDERFLOW:     return "stack underflow";
+        case FAULT_RAM_OUT_OF_RANGE:    return "ram access out of range";
+        case FAULT_BAD_KEY:             return "bad key";
+    }
+
+    return "unknown";
+}
+
+// stack_ptr points into its own struct, so it is rebased on every copy
+void chip8_snapshot_save(chip8_t *snapshot) {
+    *snapshot = chip8;
+    snapshot->stack_ptr = &snapshot->stack[chip8.stack_ptr - chip8.stack];
+}
+
+void chip8_snapshot_restore(const chip8_t *snapshot) {
+    chip8 = *snapshot;
+    chip8.stack_ptr = &chip8.stack[snapshot->stack_ptr - snapshot->stack];
+}
+
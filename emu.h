@@ -14,14 +14,34 @@ typedef struct {
     SDL_AudioDeviceID dev;
 } sdl_t;
 
+#define ROM_WATCH_INTERVAL_MS 250
+
+// behaviour differences between chip8 variants, selected per rom
+#define QUIRK_SHIFT_VY  0x01    // 8XY6/8XYE shift VY into VX
+#define QUIRK_MEMORY_I  0x02    // FX55/FX65 advance I past the registers
+
+#define FF_MULTIPLIER_MIN 2
+#define FF_MULTIPLIER_MAX 50
+
 typedef struct {
     uint32_t window_w, window_h;
     uint32_t fg_color, bk_color;
     uint32_t scale;
     bool pixel_outlines;
     uint32_t instr_per_frame;
+    uint32_t ipf_min, ipf_max;  // governor range, 0 pins it to instr_per_frame
     uint32_t square_wave_freq;
     int16_t volume;
+    uint32_t ff_multiplier;     // emulated frames per host frame while fast-forwarding
+    bool stats_overlay;
+    char *stats_path;           // telemetry export file or "unix:/socket/path"
+    char *shm_name;             // POSIX shared memory name for the state export
+    bool watch_rom;             // reload the rom when it changes on disk
+    uint32_t quirks;            // QUIRK_* bits
+    SDL_Keycode keymap[0x10];   // host key for each chip8 key
+    char *db_path;              // rom database, see romdb.h
+    bool db_save;               // benchmark mode, store the budget the governor settled on
+    uint32_t overrides;         // ROMDB_* settings given on the command line
 } config_t;
 
 typedef enum {
@@ -30,6 +50,16 @@ typedef enum {
     QUIT,
 } emu_state_t;
 
+// hazards execute_instruction() refuses to run, the machine pauses on them until the rom is reloaded
+typedef enum {
+    FAULT_NONE,
+    FAULT_PC_OUT_OF_RANGE,
+    FAULT_STACK_OVERFLOW,
+    FAULT_STACK_UNDERFLOW,
+    FAULT_RAM_OUT_OF_RANGE,
+    FAULT_BAD_KEY,
+} chip8_fault_t;
+
 typedef struct {
     uint16_t opcode;
     uint16_t NNN;   // 12 bit address
@@ -41,17 +71,26 @@ typedef struct {
 
 typedef struct {
     emu_state_t state;
+    chip8_fault_t fault;
+    bool fast_forward;
     uint8_t ram[0x1000];    // 4k
     bool display[64*32];
+    bool draw;              // display changed since the last update_screen()
     uint16_t stack[12];
     uint16_t *stack_ptr;     // stack pointer
-    uint8_t V[0xF];         // V0-VF
+    uint8_t V[0x10];        // V0-VF
     uint16_t PC;            // 2 byte 
     uint16_t I;             // 12 bit (for mem op)
     uint8_t delay_timer;
     uint8_t sound_timer;
-    bool keypad[0xF];
+    uint64_t frame;         // timer ticks since load
+    bool keypad[0x10];
     char *rom_path;
+
+    // idle loop tracking, see rom analysis
+    uint16_t idle_head;     // loop head last arrived at, 0 for none
+    uint8_t idle_V[0x10];   // registers at that arrival
+    uint32_t idle_at;       // instructions run_instructions() had run at that arrival
 } chip8_t;
 
 // SDL functions
@@ -65,20 +104,55 @@ bool clear_screen();
 
 bool update_screen();
 
+void present_screen();
+
 void user_input();
 
+// Export functions
+bool export_init();
+
+void export_state();
+
+void export_quit();
+
 // Configuration functions
 bool config_init(int argc, char **argv);
 
 uint32_t get_instr_per_frame();
 
+uint32_t get_frames_per_tick();
+
+char *get_stats_path();
+
 // Chip8 functions
 bool chip8_init(char *rom_path);
 
+void chip8_reset();
+
+bool chip8_load_rom(char *rom_path);
+
+void watch_rom();
+
+// called every frame, stores the settled budget once per load when -dbsave is set
+void save_rom_settings();
+
 emu_state_t get_chip8_state();
 
+chip8_fault_t get_chip8_fault();
+
+const char *fault_name(chip8_fault_t fault);
+
+void chip8_snapshot_save(chip8_t *snapshot);
+
+void chip8_snapshot_restore(const chip8_t *snapshot);
+
 void execute_instruction();
 
+// runs count instructions, skipping whole cycles of idle loops, returns how many really ran
+uint32_t run_instructions(uint32_t count);
+
 void update_timers();
 
+bool screen_changed();
+
 #endif
@@ -0,0 +1,337 @@
+/* Compares the batch engine against the same number of independent scalar
+ * machines spread over a pthread pool, with the same thread count on both
+ * sides. Every lane gets its own random keypad state each frame, so lanes
+ * drift apart the way they do under an exploring agent; -same gives every
+ * lane the same keys instead. The scalar workers do not wait for each other
+ * between frames, which favors them over a real agent loop.
+ *
+ * usage: batch_bench rom/file/path [-lanes n] [-threads n] [-frames n] [-ipf n] [-same]
+ */
+#define _POSIX_C_SOURCE 200809L     // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "../batch.h"
+#include "../font.h"
+
+typedef struct {
+    uint32_t lanes;
+    uint32_t threads;
+    uint32_t frames;
+    uint32_t instr_per_frame;
+    bool same_keys;
+} bench_config_t;
+
+static bench_config_t bench = {
+    .lanes = 1024,
+    .threads = 1,
+    .frames = 1000,
+    .instr_per_frame = 20,
+    .same_keys = false,
+};
+
+// one machine with its state packed together, the usual way to run instances side by side
+typedef struct {
+    uint8_t ram[0x1000];
+    uint64_t display[BATCH_DISPLAY_ROWS];
+    uint16_t stack[BATCH_STACK_SIZE];
+    uint8_t V[16];
+    uint16_t PC, I;
+    uint8_t SP;
+    uint8_t delay_timer, sound_timer;
+    uint16_t keys;
+    uint32_t rng;
+    bool fault;
+} scalar_t;
+
+typedef struct {
+    scalar_t *machines;
+    uint32_t first, count;
+    pthread_t thread;
+} scalar_worker_t;
+
+static uint8_t image[0x1000];
+static uint16_t *actions;      // actions[frame * lanes + lane]
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// same instruction semantics and hazards as the batch engine's per lane path
+static void scalar_step(scalar_t *c) {
+    if (c->PC > 0x1000 - 2) {
+        c->fault = true;
+        return;
+    }
+
+    const uint16_t opcode = c->ram[c->PC] << 8 | c->ram[c->PC + 1];
+    const uint16_t NNN = opcode & 0x0FFF;
+    const uint8_t NN = opcode & 0x0FF;
+    const uint8_t N = opcode & 0x0F;
+    const uint8_t X = (opcode >> 8) & 0x0F;
+    const uint8_t Y = (opcode >> 4) & 0x0F;
+    uint8_t *V = c->V;
+
+    c->PC += 2;
+
+    switch ((opcode >> 12) & 0x0F) {
+        case 0x0:
+            if (NN == 0xE0) memset(c->display, 0, sizeof(c->display));
+            else if (NN == 0xEE) {
+                if (c->SP == 0) goto fault;
+                c->PC = c->stack[--c->SP];
+            }
+            return;
+
+        case 0x01: c->PC = NNN; return;
+
+        case 0x02:
+            if (c->SP == BATCH_STACK_SIZE) goto fault;
+            c->stack[c->SP++] = c->PC;
+            c->PC = NNN;
+            return;
+
+        case 0x03: if (V[X] == NN) c->PC += 2; return;
+        case 0x04: if (V[X] != NN) c->PC += 2; return;
+        case 0x05: if (V[X] == V[Y]) c->PC += 2; return;
+        case 0x06: V[X] = NN; return;
+        case 0x07: V[X] += NN; return;
+
+        case 0x08:
+            switch (N) {
+                case 0: V[X] = V[Y]; return;
+                case 1: V[X] |= V[Y]; return;
+                case 2: V[X] &= V[Y]; return;
+                case 3: V[X] ^= V[Y]; return;
+                case 4: if (V[X] + V[Y] > 255) V[0xF] = 1; V[X] += V[Y]; return;
+                case 5: V[0xF] = V[X] >= V[Y]; V[X] -= V[Y]; return;
+                case 6: V[0xF] = V[X] & 1; V[X] >>= 1; return;
+                case 7: V[0xF] = V[Y] >= V[X]; V[X] = V[Y] - V[X]; return;
+                case 0xE: V[0xF] = V[X] >> 7; V[X] <<= 1; return;
+                default: return;
+            }
+
+        case 0x09: if (V[X] != V[Y]) c->PC += 2; return;
+        case 0x0A: c->I = NNN; return;
+        case 0x0B: c->PC = V[0] + NNN; return;
+
+        case 0x0C:
+            c->rng ^= c->rng << 13;
+            c->rng ^= c->rng >> 17;
+            c->rng ^= c->rng << 5;
+            V[X] = (c->rng >> 24) & NN;
+            return;
+
+        case 0x0D: {
+            if (c->I + N > 0x1000) goto fault;
+
+            const uint8_t x = V[X] % 64;
+            uint8_t y = V[Y] % BATCH_DISPLAY_ROWS;
+
+            V[0xF] = 0;
+            for (uint8_t i = 0; i < N && y < BATCH_DISPLAY_ROWS; i++, y++) {
+                const uint64_t bits = ((uint64_t) c->ram[c->I + i] << 56) >> x;
+                if (c->display[y] & bits) V[0xF] = 1;
+                c->display[y] ^= bits;
+            }
+            return;
+        }
+
+        case 0x0E:
+            if (V[X] > 0xF) goto fault;
+            if (NN == 0x9E && (c->keys >> V[X] & 1)) c->PC += 2;
+            else if (NN == 0xA1 && !(c->keys >> V[X] & 1)) c->PC += 2;
+            return;
+
+        case 0x0F:
+            switch (NN) {
+                case 0x07: V[X] = c->delay_timer; return;
+                case 0x0A:
+                    if (c->keys == 0) c->PC -= 2;
+                    else V[X] = __builtin_ctz(c->keys);
+                    return;
+                case 0x15: c->delay_timer = V[X]; return;
+                case 0x18: c->sound_timer = V[X]; return;
+                case 0x1E: c->I += V[X]; return;
+                case 0x29: c->I = V[X] * 5; return;
+                case 0x33:
+                    if (c->I + 3 > 0x1000) goto fault;
+                    c->ram[c->I] = V[X] / 100;
+                    c->ram[c->I + 1] = (V[X] % 100) / 10;
+                    c->ram[c->I + 2] = V[X] % 10;
+                    return;
+                case 0x55:
+                    if (c->I + X + 1 > 0x1000) goto fault;
+                    for (uint8_t i = 0; i <= X; i++) c->ram[c->I + i] = V[i];
+                    return;
+                case 0x65:
+                    if (c->I + X + 1 > 0x1000) goto fault;
+                    for (uint8_t i = 0; i <= X; i++) V[i] = c->ram[c->I + i];
+                    return;
+                default: return;
+            }
+    }
+    return;
+
+fault:
+    c->PC -= 2;
+    c->fault = true;
+}
+
+static void *scalar_worker(void *arg) {
+    scalar_worker_t *w = arg;
+
+    for (uint32_t f = 0; f < bench.frames; f++) {
+        for (uint32_t m = 0; m < w->count; m++) {
+            scalar_t *c = &w->machines[m];
+            if (c->fault) continue;
+
+            c->keys = actions[(size_t) f * bench.lanes + w->first + m];
+            for (uint32_t i = 0; i < bench.instr_per_frame && !c->fault; i++) scalar_step(c);
+
+            c->delay_timer -= c->delay_timer > 0;
+            c->sound_timer -= c->sound_timer > 0;
+        }
+    }
+
+    return NULL;
+}
+
+static double run_scalar(uint32_t *faulted) {
+    scalar_t *machines = calloc(bench.lanes, sizeof *machines);
+    scalar_worker_t *workers = calloc(bench.threads, sizeof *workers);
+    if (!machines || !workers) exit(EXIT_FAILURE);
+
+    for (uint32_t l = 0; l < bench.lanes; l++) {
+        memcpy(machines[l].ram, image, sizeof(image));
+        machines[l].PC = 0x200;
+        machines[l].rng = (1 ^ (l * 0x9E3779B9u)) | 1;
+    }
+
+    const uint32_t per_worker = (bench.lanes + bench.threads - 1) / bench.threads;
+    const double start = now();
+
+    for (uint32_t t = 0; t < bench.threads; t++) {
+        scalar_worker_t *w = &workers[t];
+        w->machines = machines;
+        w->first = t * per_worker < bench.lanes ? t * per_worker : bench.lanes;
+        w->count = w->first + per_worker < bench.lanes ? per_worker : bench.lanes - w->first;
+        w->machines = &machines[w->first];
+        pthread_create(&w->thread, NULL, scalar_worker, w);
+    }
+    for (uint32_t t = 0; t < bench.threads; t++) pthread_join(workers[t].thread, NULL);
+
+    const double elapsed = now() - start;
+
+    *faulted = 0;
+    for (uint32_t l = 0; l < bench.lanes; l++) *faulted += machines[l].fault;
+
+    free(machines);
+    free(workers);
+
+    return elapsed;
+}
+
+static double run_batch(const uint8_t *rom, size_t rom_size, uint32_t *faulted) {
+    chip8_batch_t *b = batch_create(bench.lanes, rom, rom_size, bench.instr_per_frame);
+    if (!b || !batch_set_threads(b, bench.threads)) {
+        fprintf(stderr, "Could not create the batch\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const double start = now();
+    for (uint32_t f = 0; f < bench.frames; f++)
+        batch_step(b, &actions[(size_t) f * bench.lanes], NULL, NULL);
+    const double elapsed = now() - start;
+
+    *faulted = b->faulted;
+    batch_destroy(b);
+
+    return elapsed;
+}
+
+static bool parse_args(int argc, char **argv) {
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-same") == 0) {
+            bench.same_keys = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return false;
+        }
+
+        if (strcmp(argv[i], "-lanes") == 0) bench.lanes = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-threads") == 0) bench.threads = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-frames") == 0) bench.frames = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-ipf") == 0) bench.instr_per_frame = strtoul(argv[++i], NULL, 10);
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return false;
+        }
+    }
+
+    if (bench.lanes == 0 || bench.threads == 0 || bench.frames == 0) {
+        fprintf(stderr, "-lanes, -threads and -frames must be at least 1\n");
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s rom/file/path [-lanes n] [-threads n] [-frames n] [-ipf n] [-same]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!parse_args(argc, argv)) exit(EXIT_FAILURE);
+
+    FILE *rom_ptr = fopen(argv[1], "rb");
+    if (!rom_ptr) {
+        fprintf(stderr, "Unable to open rom file: %s\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t rom[0x1000 - 0x200];
+    const size_t rom_size = fread(rom, 1, sizeof(rom), rom_ptr);
+    fclose(rom_ptr);
+
+    memcpy(image, font_set, sizeof(font_set));
+    memcpy(&image[0x200], rom, rom_size);
+
+    actions = malloc((size_t) bench.frames * bench.lanes * sizeof *actions);
+    if (!actions) exit(EXIT_FAILURE);
+
+    uint32_t rng = 0x2545F491;
+    for (uint32_t f = 0; f < bench.frames; f++) {
+        for (uint32_t l = 0; l < bench.lanes; l++) {
+            if (l == 0 || !bench.same_keys) {
+                rng ^= rng << 13;
+                rng ^= rng >> 17;
+                rng ^= rng << 5;
+            }
+            actions[(size_t) f * bench.lanes + l] = rng >> 16;
+        }
+    }
+
+    uint32_t scalar_faulted, batch_faulted;
+    const double scalar_s = run_scalar(&scalar_faulted);
+    const double batch_s = run_batch(rom, rom_size, &batch_faulted);
+    const double lane_frames = (double) bench.lanes * bench.frames;
+
+    printf("%u lanes, %u threads, %u frames of %u instructions, %s keys\n",
+           bench.lanes, bench.threads, bench.frames, bench.instr_per_frame,
+           bench.same_keys ? "same" : "random");
+    printf("scalar pool: %8.2f M lane-frames/s  (%u faulted)\n", lane_frames / scalar_s / 1e6, scalar_faulted);
+    printf("batch:       %8.2f M lane-frames/s  (%u faulted)\n", lane_frames / batch_s / 1e6, batch_faulted);
+    printf("speedup:     %8.2fx\n", scalar_s / batch_s);
+
+    free(actions);
+}
@@ -0,0 +1,40 @@
+/* Example consumer of the -pub shared memory export.
+ * Prints the registers and the screen of a running emulator ten times a second.
+ *
+ * usage: shm_watch /name
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../chip8_shm.h"
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s /shm-name\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    const chip8_shm_t *shm = chip8_shm_open(argv[1]);
+    if (!shm) exit(EXIT_FAILURE);
+
+    chip8_shm_t snap;
+
+    for (;;) {
+        chip8_shm_read(shm, &snap);
+
+        printf("\033[H\033[2J");    // clear terminal
+        printf("frame %llu  PC %04X  I %04X  DT %02X  ST %02X\n",
+               (unsigned long long) snap.frame, snap.PC, snap.I, snap.delay_timer, snap.sound_timer);
+        for (int r = 0; r < 16; r++) printf("V%X %02X%s", r, snap.V[r], r == 7 ? "\n" : " ");
+        printf("\n");
+
+        for (int y = 0; y < CHIP8_SHM_DISPLAY_H; y++) {
+            for (int x = 0; x < CHIP8_SHM_DISPLAY_W; x++)
+                putchar(snap.display[y * CHIP8_SHM_DISPLAY_W + x] ? '#' : ' ');
+            putchar('\n');
+        }
+
+        fflush(stdout);
+        usleep(100000);
+    }
+}
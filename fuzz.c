@@ -0,0 +1,336 @@
+/* Coverage guided fuzzer for the interpreter core.
+ * Every run starts from an in-memory snapshot of the freshly loaded rom and
+ * feeds it one keypad state per frame; with -rom the rom image is mutated too.
+ * PC/opcode edges are tracked in a bitmap and inputs reaching new edges join
+ * the corpus. Inputs that make execute_instruction() fault are written out
+ * once per fault kind and address.
+ *
+ * usage: chip8-fuzz rom/file/path [-t seconds] [-f frames] [-ipf n] [-rom] [-o dir]
+ *        chip8-fuzz rom/file/path -replay crash/file [-f frames] [-ipf n] [-rom]
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "emu.h"
+
+#define MAP_SIZE (1 << 14)
+#define MAX_FRAMES 600
+#define MAX_CORPUS 2048
+#define ROM_SPACE (0x1000 - 0x200)
+#define REPORT_MS 1000
+
+extern chip8_t chip8;
+
+typedef struct {
+    uint16_t keys[MAX_FRAMES];  // keypad bitmask per frame
+    uint8_t rom[ROM_SPACE];     // image at 0x200, used with -rom
+} testcase_t;
+
+typedef struct {
+    uint32_t seconds;
+    uint32_t frames;
+    uint32_t instr_per_frame;
+    bool mutate_rom;
+    char *out_dir;
+    char *replay_path;
+} fuzz_config_t;
+
+static fuzz_config_t fuzz = {
+    .seconds = 60,
+    .frames = 30,
+    .instr_per_frame = 20,
+    .mutate_rom = false,
+    .out_dir = "crashes",
+    .replay_path = NULL,
+};
+
+static chip8_t snapshot;
+static testcase_t corpus[MAX_CORPUS];
+static uint32_t corpus_size = 0;
+
+static uint8_t trace[MAP_SIZE];
+static uint16_t touched[MAP_SIZE];  // trace entries the last run hit, only these are classified and cleared
+static uint32_t touched_count = 0;
+static uint8_t virgin[MAP_SIZE];
+static uint32_t edges = 0;
+
+static bool crash_seen[8][0x1000];
+static uint32_t crashes = 0;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// runs one input from the snapshot, recording edges into trace
+static chip8_fault_t run(const testcase_t *tc) {
+    chip8_snapshot_restore(&snapshot);
+    if (fuzz.mutate_rom) memcpy(&chip8.ram[0x200], tc->rom, ROM_SPACE);
+
+    srand(1);   // keeps Cxkk reproducible
+    for (uint32_t i = 0; i < touched_count; i++) trace[touched[i]] = 0;
+    touched_count = 0;
+
+    uint32_t prev = 0;
+
+    for (uint32_t f = 0; f < fuzz.frames; f++) {
+        for (uint8_t k = 0; k < sizeof(chip8.keypad); k++)
+            chip8.keypad[k] = (tc->keys[f] >> k) & 1;
+
+        for (uint32_t i = 0; i < fuzz.instr_per_frame; i++) {
+            const uint16_t pc = chip8.PC;
+            const uint16_t opcode = pc < sizeof(chip8.ram) - 1 ? chip8.ram[pc] << 8 | chip8.ram[pc + 1] : 0;
+            const uint32_t cur = (pc * 0x9E37u ^ opcode * 0x85EBu) & (MAP_SIZE - 1);
+
+            // saturates rather than wrapping, 255 hits still land in the top bucket
+            const uint32_t edge = cur ^ prev;
+            if (!trace[edge]) touched[touched_count++] = edge;
+            trace[edge] += trace[edge] != 0xFF;
+            prev = cur >> 1;
+
+            execute_instruction();
+            if (chip8.fault != FAULT_NONE) return chip8.fault;
+        }
+
+        update_timers();
+    }
+
+    return FAULT_NONE;
+}
+
+// AFL style hit count buckets, so loops running longer also count as new
+static uint8_t bucket(uint8_t hits) {
+    if (hits <= 3) return hits == 3 ? 4 : hits;
+    if (hits <= 7) return 8;
+    if (hits <= 15) return 16;
+    if (hits <= 31) return 32;
+    if (hits <= 127) return 64;
+    return 128;
+}
+
+static bool new_coverage() {
+    bool found = false;
+
+    for (uint32_t i = 0; i < touched_count; i++) {
+        const uint16_t j = touched[i];
+
+        const uint8_t b = bucket(trace[j]);
+        if (virgin[j] & b) {
+            if (virgin[j] == 0xFF) edges++;
+            virgin[j] &= ~b;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+static bool write_testcase(const char *path, const testcase_t *tc) {
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        fprintf(stderr, "Could not write %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fwrite(tc->keys, sizeof(tc->keys[0]), fuzz.frames, out);
+    if (fuzz.mutate_rom) fwrite(tc->rom, 1, ROM_SPACE, out);
+    fclose(out);
+
+    return true;
+}
+
+static bool read_testcase(const char *path, testcase_t *tc) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    memcpy(tc->rom, &snapshot.ram[0x200], ROM_SPACE);
+    memset(tc->keys, 0, sizeof(tc->keys));
+
+    const bool ok = fread(tc->keys, sizeof(tc->keys[0]), fuzz.frames, in) == fuzz.frames &&
+                    (!fuzz.mutate_rom || fread(tc->rom, 1, ROM_SPACE, in) == ROM_SPACE);
+    fclose(in);
+
+    if (!ok) fprintf(stderr, "%s does not match -f/-rom\n", path);
+    return ok;
+}
+
+static void report_crash(chip8_fault_t fault, const testcase_t *tc) {
+    const uint16_t pc = chip8.PC & 0xFFF;
+
+    if (crash_seen[fault][pc]) return;
+    crash_seen[fault][pc] = true;
+    crashes++;
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s-%03X.bin", fuzz.out_dir, fault_name(fault), pc);
+    for (char *c = path + strlen(fuzz.out_dir); *c; c++) if (*c == ' ') *c = '_';
+
+    printf("fault: %s at PC 0x%03X, input saved to %s\n", fault_name(fault), pc, path);
+    write_testcase(path, tc);
+}
+
+static void mutate(testcase_t *tc) {
+    const uint32_t ops = 1 + rng() % 4;
+
+    for (uint32_t n = 0; n < ops; n++) {
+        const uint32_t f = rng() % fuzz.frames;
+        const uint32_t len = 1 + rng() % 30;
+
+        switch (rng() % (fuzz.mutate_rom ? 8 : 5)) {
+            case 0:
+                // press or release one key in one frame
+                tc->keys[f] ^= 1 << (rng() % 16);
+                break;
+
+            case 1:
+                tc->keys[f] = rng();
+                break;
+
+            case 2:
+                // hold a key for a while
+                for (uint32_t i = f; i < f + len && i < fuzz.frames; i++) tc->keys[i] |= 1 << (rng() % 16);
+                break;
+
+            case 3:
+                for (uint32_t i = f; i < f + len && i < fuzz.frames; i++) tc->keys[i] = 0;
+                break;
+
+            case 4: {
+                // splice the key tail of another corpus entry
+                const testcase_t *other = &corpus[rng() % corpus_size];
+                memcpy(&tc->keys[f], &other->keys[f], (fuzz.frames - f) * sizeof(tc->keys[0]));
+                break;
+            }
+
+            case 5:
+                tc->rom[rng() % ROM_SPACE] ^= 1 << (rng() % 8);
+                break;
+
+            case 6:
+                tc->rom[rng() % ROM_SPACE] = rng();
+                break;
+
+            case 7: {
+                // random instruction on an even address
+                const uint32_t a = (rng() % (ROM_SPACE / 2)) * 2;
+                const uint16_t opcode = rng();
+                tc->rom[a] = opcode >> 8;
+                tc->rom[a + 1] = opcode & 0xFF;
+                break;
+            }
+        }
+    }
+}
+
+static bool parse_args(int argc, char **argv) {
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-rom") == 0) {
+            fuzz.mutate_rom = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return false;
+        }
+
+        if (strcmp(argv[i], "-t") == 0) fuzz.seconds = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-f") == 0) fuzz.frames = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-ipf") == 0) fuzz.instr_per_frame = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-o") == 0) fuzz.out_dir = argv[++i];
+        else if (strcmp(argv[i], "-replay") == 0) fuzz.replay_path = argv[++i];
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return false;
+        }
+    }
+
+    if (fuzz.frames == 0 || fuzz.frames > MAX_FRAMES) {
+        fprintf(stderr, "-f must be between 1 and %d\n", MAX_FRAMES);
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s rom/file/path [-t seconds] [-f frames] [-ipf n] [-rom] [-o dir] [-replay file]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!parse_args(argc, argv)) exit(EXIT_FAILURE);
+
+    // defaults only, no window or audio is ever opened
+    if (!config_init(1, argv)) exit(EXIT_FAILURE);
+
+    if (!chip8_init(argv[1])) exit(EXIT_FAILURE);
+    chip8_snapshot_save(&snapshot);
+
+    testcase_t *tc = &corpus[0];
+    memcpy(tc->rom, &snapshot.ram[0x200], ROM_SPACE);
+
+    if (fuzz.replay_path) {
+        if (!read_testcase(fuzz.replay_path, tc)) exit(EXIT_FAILURE);
+
+        const chip8_fault_t fault = run(tc);
+        printf("%s at PC 0x%03X\n", fault_name(fault), chip8.PC);
+        exit(fault == FAULT_NONE ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    if (mkdir(fuzz.out_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create %s: %s\n", fuzz.out_dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    memset(virgin, 0xFF, sizeof(virgin));
+
+    // seed with no keys pressed
+    run(tc);
+    new_coverage();
+    corpus_size = 1;
+
+    testcase_t candidate;
+    uint64_t execs = 0, last_execs = 0;
+    const uint32_t start = SDL_GetTicks();
+    uint32_t last_report = start;
+
+    while (SDL_GetTicks() - start < fuzz.seconds * 1000) {
+        // the clock is only read every so often, it costs more than a run
+        for (uint32_t n = 0; n < 256; n++) {
+            candidate = corpus[rng() % corpus_size];
+            mutate(&candidate);
+
+            const chip8_fault_t fault = run(&candidate);
+            execs++;
+
+            if (fault != FAULT_NONE) report_crash(fault, &candidate);
+
+            if (new_coverage() && corpus_size < MAX_CORPUS)
+                corpus[corpus_size++] = candidate;
+        }
+
+        const uint32_t now = SDL_GetTicks();
+        if (now - last_report >= REPORT_MS) {
+            printf("execs %llu (%llu/s), corpus %u, edges %u, faults %u\n",
+                   (unsigned long long) execs,
+                   (unsigned long long) ((execs - last_execs) * 1000 / (now - last_report)),
+                   corpus_size, edges, crashes);
+            last_execs = execs;
+            last_report = now;
+        }
+    }
+
+    printf("done: %llu execs, corpus %u, edges %u, faults %u\n",
+           (unsigned long long) execs, corpus_size, edges, crashes);
+
+    exit(crashes ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,113 @@
+#include "governor.h"
+
+governor_t governor = {0};
+
+void governor_init(uint32_t ipf, uint32_t min_ipf, uint32_t max_ipf) {
+    // an unset bound pins that side to the nominal value
+    if (min_ipf == 0 || min_ipf > ipf) min_ipf = ipf;
+    if (max_ipf < ipf) max_ipf = ipf;
+
+    governor = (governor_t){
+        .enabled = min_ipf != max_ipf,
+        .min_ipf = min_ipf,
+        .max_ipf = max_ipf,
+        .nominal_ipf = ipf,
+        .ipf = ipf,
+    };
+
+    if (governor.enabled)
+        SDL_Log("Governor: instructions per frame %u, range %u-%u", ipf, min_ipf, max_ipf);
+}
+
+static void set_ipf(uint32_t ipf, const char *reason) {
+    SDL_Log("Governor: instructions per frame %u -> %u (%s, emulate %lluus, render %lluus)",
+            governor.ipf, ipf, reason,
+            (unsigned long long) governor.emulate_avg, (unsigned long long) governor.render_avg);
+    governor.ipf = ipf;
+    governor.stable_frames = 0;
+}
+
+static void set_skip_unchanged(bool skip) {
+    SDL_Log("Governor: %s presenting unchanged frames (emulate %lluus, render %lluus)",
+            skip ? "stopped" : "resumed",
+            (unsigned long long) governor.emulate_avg, (unsigned long long) governor.render_avg);
+    governor.skip_unchanged = skip;
+    governor.stable_frames = 0;
+}
+
+static void degrade() {
+    // shed rendering first, it does not change how the game plays
+    if (!governor.skip_unchanged) {
+        set_skip_unchanged(true);
+        return;
+    }
+
+    if (governor.ipf == governor.min_ipf) return;
+
+    // size the budget so emulation fits in what rendering leaves over
+    const uint64_t per_instr = governor.emulate_avg / governor.ipf + 1;
+    const uint64_t room = governor.render_avg < GOVERNOR_HIGH_US ? GOVERNOR_HIGH_US - governor.render_avg : 0;
+    uint64_t ipf = room / per_instr;
+
+    if (ipf >= governor.ipf) ipf = governor.ipf - 1;
+    if (ipf < governor.min_ipf) ipf = governor.min_ipf;
+
+    set_ipf(ipf, "over budget");
+}
+
+static void recover() {
+    const uint32_t step = governor.ipf / 16 ? governor.ipf / 16 : 1;
+
+    if (governor.ipf < governor.nominal_ipf) {
+        set_ipf(governor.ipf + step < governor.nominal_ipf ? governor.ipf + step : governor.nominal_ipf, "headroom");
+    }
+    else if (governor.skip_unchanged) {
+        set_skip_unchanged(false);
+    }
+    else if (governor.ipf < governor.max_ipf) {
+        set_ipf(governor.ipf + step < governor.max_ipf ? governor.ipf + step : governor.max_ipf, "headroom");
+    }
+}
+
+void governor_update(uint64_t emulate_us, uint64_t render_us) {
+    if (!governor.enabled) return;
+
+    // exponential moving average, 1/8 weight for the new sample
+    governor.emulate_avg = (governor.emulate_avg * 7 + emulate_us) / 8;
+    governor.render_avg = (governor.render_avg * 7 + render_us) / 8;
+
+    const uint64_t cost = governor.emulate_avg + governor.render_avg;
+
+    if (governor.stable_frames < GOVERNOR_SETTLE_FRAMES) governor.stable_frames++;
+
+    if (cost > GOVERNOR_HIGH_US) {
+        governor.under_frames = 0;
+        if (++governor.over_frames >= GOVERNOR_DEGRADE_FRAMES) {
+            governor.over_frames = 0;
+            degrade();
+        }
+    }
+    else if (cost < GOVERNOR_LOW_US) {
+        governor.over_frames = 0;
+        if (++governor.under_frames >= GOVERNOR_RECOVER_FRAMES) {
+            governor.under_frames = 0;
+            recover();
+        }
+    }
+    else {
+        governor.over_frames = 0;
+        governor.under_frames = 0;
+    }
+}
+
+uint32_t governor_instr_per_frame() {
+    return governor.ipf;
+}
+
+bool governor_skip_unchanged() {
+    return governor.skip_unchanged;
+}
+
+bool governor_settled() {
+    return governor.enabled && governor.stable_frames >= GOVERNOR_SETTLE_FRAMES;
+}
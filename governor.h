@@ -0,0 +1,47 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "telemetry.h"
+
+/* Keeps the host frame inside its 60 fps budget by trading work for time.
+ * Under load it first stops presenting frames that did not change, then
+ * lowers instructions per frame towards the minimum; with headroom it
+ * restores them in reverse order and may climb up to the maximum.
+ */
+
+#define GOVERNOR_HIGH_US (FRAME_BUDGET_US * 9 / 10)     // degrade above this cost
+#define GOVERNOR_LOW_US (FRAME_BUDGET_US / 2)           // recover below this cost
+#define GOVERNOR_DEGRADE_FRAMES 30
+#define GOVERNOR_RECOVER_FRAMES 120
+#define GOVERNOR_SETTLE_FRAMES 600      // frames without a change before the budget counts as settled
+
+typedef struct {
+    bool enabled;
+    uint32_t min_ipf, max_ipf;
+    uint32_t nominal_ipf;       // the -ipf value
+    uint32_t ipf;               // current budget
+    bool skip_unchanged;        // rendering shed, only changed frames are presented
+
+    // moving averages in microseconds
+    uint64_t emulate_avg;
+    uint64_t render_avg;
+
+    uint32_t over_frames;
+    uint32_t under_frames;
+    uint32_t stable_frames;     // since the budget or presenting last changed
+} governor_t;
+
+void governor_init(uint32_t ipf, uint32_t min_ipf, uint32_t max_ipf);
+
+void governor_update(uint64_t emulate_us, uint64_t render_us);
+
+uint32_t governor_instr_per_frame();
+
+bool governor_skip_unchanged();
+
+// the governor is on and held the same budget for GOVERNOR_SETTLE_FRAMES
+bool governor_settled();
+
+#endif
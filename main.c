@@ -1,6 +1,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "emu.h"
+#include "telemetry.h"
+#include "governor.h"
 
 int main(int argc, char **argv) {
     if (argc < 2) {
@@ -14,32 +16,77 @@ int main(int argc, char **argv) {
 
     if (!chip8_init(argv[1])) exit(EXIT_FAILURE);
     
+    if (!telemetry_init(get_stats_path())) exit(EXIT_FAILURE);
+
+    if (!export_init()) exit(EXIT_FAILURE);
+
     clear_screen();
 
-    int64_t last_ticks = SDL_GetTicks();
-    int64_t last_delta = 0;
+    uint64_t last_frame_start = telemetry_now_us();
+    chip8_fault_t reported = FAULT_NONE;
 
     while (get_chip8_state() != 2) {
+        const uint64_t frame_start = telemetry_now_us();
+        telemetry_record(TM_FRAME, frame_start - last_frame_start);
+        last_frame_start = frame_start;
+
         user_input();
-        
-        last_delta = SDL_GetTicks() - last_ticks;
-        last_ticks = SDL_GetTicks();
-        
-        for (uint32_t i = 0; i < get_instr_per_frame(); i++) {
-            execute_instruction();
+        watch_rom();
+
+        // in fast-forward several frames are emulated per host frame,
+        // only the last one is presented
+        const uint32_t frames = get_frames_per_tick();
+        const uint32_t instr_per_frame = governor_instr_per_frame();
+        uint32_t executed = 0;
+        // a faulted rom stays paused, timers included, until it is reloaded
+        for (uint32_t f = 0; f < frames && get_chip8_state() == RUNNING; f++) {
+            executed += run_instructions(instr_per_frame);
+
+            if (get_chip8_state() == RUNNING) update_timers();
+        }
+
+        if (get_chip8_fault() != reported) {
+            reported = get_chip8_fault();
+            if (reported != FAULT_NONE)
+                SDL_Log("Rom stopped: %s, paused until it is reloaded", fault_name(reported));
         }
+        export_state();
+        const uint64_t emulated = telemetry_now_us();
+        telemetry_record(TM_EMULATE, emulated - frame_start);
+
+        // a degraded governor only presents frames that changed
+        const bool present = !governor_skip_unchanged() || screen_changed();
+
+        if (present) update_screen();
+        const uint64_t rendered = telemetry_now_us();
+        telemetry_record(TM_RENDER, rendered - emulated);
 
-        update_screen();
-        update_timers();
+        if (present) present_screen();
+        const uint64_t presented = telemetry_now_us();
+        telemetry_record(TM_PRESENT, presented - rendered);
 
-        double elapsed_time = (double) (SDL_GetTicks() - last_ticks);
+        // fast-forward overruns the budget on purpose, keep it out of the governor
+        if (frames == 1 && get_chip8_state() == RUNNING) governor_update(emulated - frame_start, presented - emulated);
+        save_rom_settings();
 
-        if (elapsed_time < 16.67f)
-            SDL_Delay(16.67f - elapsed_time);
+        const uint64_t busy = presented - frame_start;
+        telemetry_end_frame(busy, executed);
+        telemetry_export();
+
+        if (busy < FRAME_BUDGET_US) {
+            const uint32_t delay_ms = (FRAME_BUDGET_US - busy) / 1000;
+            const uint64_t sleep_start = telemetry_now_us();
+            SDL_Delay(delay_ms);
+
+            const uint64_t slept = telemetry_now_us() - sleep_start;
+            telemetry_record(TM_SLEEP_OVERSHOOT, slept > delay_ms * 1000 ? slept - delay_ms * 1000 : 0);
+        }
         else
             SDL_Delay(0);
     }
 
+    telemetry_quit();
+    export_quit();
 
     // quit SDL
     sdl_quit();     
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "romdb.h"
+
+static romdb_entry_t *entries = NULL;
+static uint32_t entry_count = 0;
+
+// $XDG_CONFIG_HOME/chip8/romdb.bin or ~/.config/chip8/romdb.bin
+const char *romdb_default_path() {
+    static char path[4096];
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+
+    if (xdg && *xdg) snprintf(path, sizeof(path), "%s/chip8/romdb.bin", xdg);
+    else if (home && *home) snprintf(path, sizeof(path), "%s/.config/chip8/romdb.bin", home);
+    else return NULL;
+
+    return path;
+}
+
+bool romdb_load(const char *path) {
+    free(entries);
+    entries = NULL;
+    entry_count = 0;
+
+    FILE *in = fopen(path, "rb");
+    if (!in) return errno == ENOENT;
+
+    romdb_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        header.magic != ROMDB_MAGIC || header.version != ROMDB_VERSION) {
+        fprintf(stderr, "%s is not a rom database v%d\n", path, ROMDB_VERSION);
+        fclose(in);
+        return false;
+    }
+
+    entries = malloc((size_t) header.count * sizeof(*entries));
+    if (header.count && (!entries || fread(entries, sizeof(*entries), header.count, in) != header.count)) {
+        fprintf(stderr, "Rom database %s is truncated\n", path);
+        free(entries);
+        entries = NULL;
+        fclose(in);
+        return false;
+    }
+    entry_count = header.count;
+
+    fclose(in);
+    return true;
+}
+
+static int compare_hash(const void *key, const void *entry) {
+    const uint64_t a = *(const uint64_t *) key;
+    const uint64_t b = ((const romdb_entry_t *) entry)->hash;
+
+    return (a > b) - (a < b);
+}
+
+const romdb_entry_t *romdb_find(uint64_t hash) {
+    if (!entry_count) return NULL;
+
+    return bsearch(&hash, entries, entry_count, sizeof(*entries), compare_hash);
+}
+
+uint32_t romdb_count() {
+    return entry_count;
+}
+
+const romdb_entry_t *romdb_entries() {
+    return entries;
+}
+
+static bool write_db(const char *path) {
+    // make sure the directory exists, ignoring errors the fopen below reports
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *slash = strchr(dir + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(dir, 0755);
+        *slash = '/';
+    }
+
+    char tmp_path[4200];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int) getpid());
+
+    FILE *out = fopen(tmp_path, "wb");
+    if (!out) {
+        fprintf(stderr, "Could not write %s: %s\n", tmp_path, strerror(errno));
+        return false;
+    }
+
+    const romdb_header_t header = {
+        .magic = ROMDB_MAGIC,
+        .version = ROMDB_VERSION,
+        .count = entry_count,
+    };
+    const bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                    fwrite(entries, sizeof(*entries), entry_count, out) == entry_count;
+    fclose(out);
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Could not write %s: %s\n", path, strerror(errno));
+        remove(tmp_path);
+        return false;
+    }
+
+    return true;
+}
+
+bool romdb_store(const char *path, const romdb_entry_t *entry) {
+    // reload so entries written by other instances are kept
+    if (!romdb_load(path)) return false;
+
+    romdb_entry_t *stored = (romdb_entry_t *) romdb_find(entry->hash);
+
+    if (!stored) {
+        romdb_entry_t *grown = realloc(entries, (size_t) (entry_count + 1) * sizeof(*entries));
+        if (!grown) return false;
+        entries = grown;
+
+        // insert keeping the hash order
+        uint32_t i = entry_count;
+        while (i > 0 && entries[i - 1].hash > entry->hash) {
+            entries[i] = entries[i - 1];
+            i--;
+        }
+        stored = &entries[i];
+        *stored = (romdb_entry_t){ .hash = entry->hash };
+        entry_count++;
+    }
+
+    if (entry->fields & ROMDB_IPF) stored->instr_per_frame = entry->instr_per_frame;
+    if (entry->fields & ROMDB_QUIRKS) stored->quirks = entry->quirks;
+    if (entry->fields & ROMDB_KEYMAP) memcpy(stored->keymap, entry->keymap, sizeof(stored->keymap));
+    if (entry->fields & ROMDB_COLORS) {
+        stored->fg_color = entry->fg_color;
+        stored->bk_color = entry->bk_color;
+    }
+    if (entry->fields & ROMDB_ENGINE) stored->engine = entry->engine;
+    stored->fields |= entry->fields;
+
+    return write_db(path);
+}
+
+bool romdb_remove(const char *path, uint64_t hash) {
+    if (!romdb_load(path)) return false;
+
+    const romdb_entry_t *stored = romdb_find(hash);
+    if (!stored) return true;
+
+    const uint32_t i = stored - entries;
+    memmove(&entries[i], &entries[i + 1], (entry_count - i - 1) * sizeof(*entries));
+    entry_count--;
+
+    return write_db(path);
+}
@@ -0,0 +1,58 @@
+#ifndef ROMDB_H
+#define ROMDB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Per rom settings keyed by the FNV-1a hash of the rom image (rom_hash()).
+ * The file is a header followed by entries sorted by hash, read once and
+ * searched in place.
+ */
+
+#define ROMDB_MAGIC 0x42443843      // "C8DB"
+#define ROMDB_VERSION 1
+
+// settings an entry carries, everything else keeps its default
+#define ROMDB_IPF       0x01
+#define ROMDB_QUIRKS    0x02
+#define ROMDB_KEYMAP    0x04
+#define ROMDB_COLORS    0x08
+#define ROMDB_ENGINE    0x10
+
+#define ENGINE_INTERPRETER 0        // the only engine so far
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+} romdb_header_t;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t fields;            // ROMDB_* bits
+    uint32_t instr_per_frame;
+    uint32_t quirks;            // QUIRK_* bits
+    uint32_t fg_color, bk_color;
+    int32_t keymap[16];         // SDL keycode for chip8 keys 0-F
+    uint8_t engine;
+    uint8_t reserved[3];
+} romdb_entry_t;
+
+const char *romdb_default_path();
+
+// a missing file is an empty database
+bool romdb_load(const char *path);
+
+const romdb_entry_t *romdb_find(uint64_t hash);
+
+uint32_t romdb_count();
+
+const romdb_entry_t *romdb_entries();
+
+// merges the fields set in entry into the stored one and rewrites the file
+bool romdb_store(const char *path, const romdb_entry_t *entry);
+
+bool romdb_remove(const char *path, uint64_t hash);
+
+#endif
@@ -0,0 +1,159 @@
+/* chip8-romdb: lists and edits the per rom settings the emulator applies
+ * when it loads a rom. Roms are identified by the hash of their contents,
+ * so renamed or moved copies share one entry.
+ *
+ * usage: chip8-romdb [-db path] list
+ *        chip8-romdb [-db path] set rom/file/path [ipf=n] [quirks=n] [fg=RRGGBBAA] [bg=RRGGBBAA] [keys=...] [engine=n]
+ *        chip8-romdb [-db path] rm rom/file/path
+ *
+ * keys= takes 16 characters, the host key for chip8 keys 0 to F in order,
+ * the default layout is x123qweasdzc4rfv.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "analyze.h"
+#include "romdb.h"
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-db path] list\n"
+            "       %s [-db path] set rom/file/path [ipf=n] [quirks=n] [fg=RRGGBBAA] [bg=RRGGBBAA] [keys=x123qweasdzc4rfv] [engine=n]\n"
+            "       %s [-db path] rm rom/file/path\n",
+            name, name, name);
+    exit(EXIT_FAILURE);
+}
+
+static bool hash_rom_file(const char *path, uint64_t *hash) {
+    FILE *rom_ptr = fopen(path, "rb");
+    if (!rom_ptr) {
+        fprintf(stderr, "Unable to open rom file: %s\n", path);
+        return false;
+    }
+
+    uint8_t rom[ANALYSIS_RAM_SIZE - ANALYSIS_ROM_START];
+    const size_t rom_size = fread(rom, 1, sizeof(rom), rom_ptr);
+    const bool too_big = fgetc(rom_ptr) != EOF;
+    fclose(rom_ptr);
+
+    if (rom_size == 0 || too_big) {
+        fprintf(stderr, "Rom file is empty or does not fit in Ram: %s\n", path);
+        return false;
+    }
+
+    *hash = rom_hash(rom, rom_size);
+    return true;
+}
+
+static void list() {
+    const romdb_entry_t *entries = romdb_entries();
+
+    for (uint32_t i = 0; i < romdb_count(); i++) {
+        const romdb_entry_t *e = &entries[i];
+
+        printf("%016llx", (unsigned long long) e->hash);
+        if (e->fields & ROMDB_IPF) printf(" ipf=%u", e->instr_per_frame);
+        if (e->fields & ROMDB_QUIRKS) printf(" quirks=0x%X", e->quirks);
+        if (e->fields & ROMDB_COLORS) printf(" fg=%08X bg=%08X", e->fg_color, e->bk_color);
+        if (e->fields & ROMDB_KEYMAP) {
+            printf(" keys=");
+            for (uint8_t k = 0; k < 0x10; k++)
+                putchar(e->keymap[k] > ' ' && e->keymap[k] < 0x7F ? e->keymap[k] : '?');
+        }
+        if (e->fields & ROMDB_ENGINE) printf(" engine=%u", e->engine);
+        printf("\n");
+    }
+}
+
+static bool parse_setting(const char *arg, romdb_entry_t *entry) {
+    const char *value = strchr(arg, '=');
+    if (!value) return false;
+
+    const size_t len = value - arg;
+    value++;
+
+    if (strncmp(arg, "ipf", len) == 0 && len == 3) {
+        entry->instr_per_frame = strtoul(value, NULL, 10);
+        entry->fields |= ROMDB_IPF;
+    }
+    else if (strncmp(arg, "quirks", len) == 0 && len == 6) {
+        entry->quirks = strtoul(value, NULL, 0);
+        entry->fields |= ROMDB_QUIRKS;
+    }
+    else if ((strncmp(arg, "fg", len) == 0 || strncmp(arg, "bg", len) == 0) && len == 2) {
+        // a pair is stored, the other color keeps the default
+        if (!(entry->fields & ROMDB_COLORS)) {
+            entry->fg_color = 0xFFFFFFFF;
+            entry->bk_color = 0x00000000;
+        }
+        if (arg[0] == 'f') entry->fg_color = strtoul(value, NULL, 16);
+        else entry->bk_color = strtoul(value, NULL, 16);
+        entry->fields |= ROMDB_COLORS;
+    }
+    else if (strncmp(arg, "keys", len) == 0 && len == 4) {
+        if (strlen(value) != 0x10) {
+            fprintf(stderr, "keys= needs 16 characters, one per chip8 key 0 to F\n");
+            return false;
+        }
+        // SDL keycodes of letters and digits are their lowercase characters
+        for (uint8_t k = 0; k < 0x10; k++)
+            entry->keymap[k] = value[k] >= 'A' && value[k] <= 'Z' ? value[k] - 'A' + 'a' : value[k];
+        entry->fields |= ROMDB_KEYMAP;
+    }
+    else if (strncmp(arg, "engine", len) == 0 && len == 6) {
+        entry->engine = strtoul(value, NULL, 10);
+        entry->fields |= ROMDB_ENGINE;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *db_path = romdb_default_path();
+    int arg = 1;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-db") == 0) {
+        db_path = argv[arg + 1];
+        arg += 2;
+    }
+
+    if (arg >= argc) usage(argv[0]);
+
+    if (!db_path) {
+        fprintf(stderr, "No rom database path, set HOME or use -db\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *command = argv[arg++];
+
+    if (strcmp(command, "list") == 0) {
+        if (!romdb_load(db_path)) exit(EXIT_FAILURE);
+        list();
+        exit(EXIT_SUCCESS);
+    }
+
+    if (arg >= argc) usage(argv[0]);
+
+    romdb_entry_t entry = {0};
+    if (!hash_rom_file(argv[arg++], &entry.hash)) exit(EXIT_FAILURE);
+
+    if (strcmp(command, "rm") == 0) {
+        exit(romdb_remove(db_path, entry.hash) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    if (strcmp(command, "set") != 0) usage(argv[0]);
+
+    for (; arg < argc; arg++) {
+        if (!parse_setting(argv[arg], &entry)) {
+            fprintf(stderr, "Unknown setting %s\n", argv[arg]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!entry.fields) usage(argv[0]);
+
+    exit(romdb_store(db_path, &entry) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,275 @@
+#define _GNU_SOURCE     // accept4, SOCK_NONBLOCK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "telemetry.h"
+
+#define UNIX_PREFIX "unix:"
+
+telemetry_t telemetry = {0};
+
+static const char *metric_names[TM_COUNT] = {
+    [TM_EMULATE]         = "chip8_frame_emulate_seconds",
+    [TM_RENDER]          = "chip8_frame_render_seconds",
+    [TM_PRESENT]         = "chip8_frame_present_seconds",
+    [TM_SLEEP_OVERSHOOT] = "chip8_sleep_overshoot_seconds",
+    [TM_FRAME]           = "chip8_frame_seconds",
+};
+
+static const char *metric_help[TM_COUNT] = {
+    [TM_EMULATE]         = "Time spent executing instructions and ticking timers per host frame.",
+    [TM_RENDER]          = "Time spent drawing the display per host frame.",
+    [TM_PRESENT]         = "Time spent presenting the frame.",
+    [TM_SLEEP_OVERSHOOT] = "Time slept past the requested frame delay.",
+    [TM_FRAME]           = "Wall time between the start of two host frames.",
+};
+
+/* Only a socket nobody listens on any more, left by an emulator that
+ * crashed, is removed. A live socket or any other file is left alone.
+ */
+static bool socket_stale(const struct sockaddr_un *addr) {
+    struct stat st;
+    if (lstat(addr->sun_path, &st) != 0 || !S_ISSOCK(st.st_mode)) return false;
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+
+    const bool stale = connect(fd, (const struct sockaddr *) addr, sizeof *addr) != 0 && errno == ECONNREFUSED;
+    close(fd);
+
+    return stale;
+}
+
+static bool open_socket(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (strlen(path) >= sizeof addr.sun_path) {
+        SDL_Log("Telemetry socket path too long: %s", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+
+    telemetry.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (telemetry.listen_fd < 0) {
+        SDL_Log("Could not create telemetry socket: %s", strerror(errno));
+        return false;
+    }
+
+    bool bound = bind(telemetry.listen_fd, (struct sockaddr *) &addr, sizeof addr) == 0;
+    if (!bound && errno == EADDRINUSE) {
+        if (!socket_stale(&addr)) {
+            SDL_Log("Telemetry socket %s is in use or not a socket, pick another path", path);
+            close(telemetry.listen_fd);
+            telemetry.listen_fd = -1;
+            return false;
+        }
+
+        SDL_Log("Removing stale telemetry socket %s", path);
+        unlink(path);
+        bound = bind(telemetry.listen_fd, (struct sockaddr *) &addr, sizeof addr) == 0;
+    }
+
+    if (!bound || listen(telemetry.listen_fd, 4) != 0) {
+        SDL_Log("Could not listen on telemetry socket %s: %s", path, strerror(errno));
+        close(telemetry.listen_fd);
+        telemetry.listen_fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+bool telemetry_init(const char *export_path) {
+    telemetry = (telemetry_t){
+        .export_path = export_path,
+        .listen_fd = -1,
+    };
+
+    telemetry.window_start_us = telemetry_now_us();
+
+    if (export_path && strncmp(export_path, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0)
+        return open_socket(export_path + strlen(UNIX_PREFIX));
+
+    return true;
+}
+
+void telemetry_quit() {
+    if (telemetry.listen_fd >= 0) {
+        close(telemetry.listen_fd);
+        unlink(telemetry.export_path + strlen(UNIX_PREFIX));
+        telemetry.listen_fd = -1;
+    }
+}
+
+uint64_t telemetry_now_us() {
+    const uint64_t counter = SDL_GetPerformanceCounter();
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+
+    // scaling the counter first overflows after a few hours of uptime at 1GHz
+    return counter / freq * 1000000 + counter % freq * 1000000 / freq;
+}
+
+void telemetry_record(telemetry_metric_t metric, uint64_t us) {
+    histogram_t *h = &telemetry.hist[metric];
+
+    // bucket k holds values <= 2^k us, the last one is +Inf
+    uint32_t k = 0;
+    while (k < HISTOGRAM_BUCKETS - 1 && us > (1ull << k)) k++;
+
+    h->buckets[k]++;
+    h->count++;
+    h->sum_us += us;
+    if (us > h->max_us) h->max_us = us;
+}
+
+void telemetry_end_frame(uint64_t busy_us, uint32_t instructions) {
+    telemetry.frames++;
+    telemetry.instructions += instructions;
+    telemetry.window_instructions += instructions;
+
+    if (busy_us > FRAME_BUDGET_US) {
+        telemetry.late_frames++;
+        telemetry.dropped_frames += busy_us / FRAME_BUDGET_US;
+    }
+
+    telemetry.recent_us[telemetry.recent_head] = busy_us > UINT32_MAX ? UINT32_MAX : (uint32_t) busy_us;
+    telemetry.recent_head = (telemetry.recent_head + 1) % OVERLAY_SAMPLES;
+}
+
+// writes all stats in the Prometheus text exposition format
+static void write_stats(FILE *out) {
+    for (uint32_t m = 0; m < TM_COUNT; m++) {
+        const histogram_t *h = &telemetry.hist[m];
+        uint64_t cumulative = 0;
+
+        fprintf(out, "# HELP %s %s\n", metric_names[m], metric_help[m]);
+        fprintf(out, "# TYPE %s histogram\n", metric_names[m]);
+
+        for (uint32_t k = 0; k < HISTOGRAM_BUCKETS - 1; k++) {
+            cumulative += h->buckets[k];
+            fprintf(out, "%s_bucket{le=\"%.6f\"} %llu\n", metric_names[m],
+                    (double) (1ull << k) / 1e6, (unsigned long long) cumulative);
+        }
+        fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", metric_names[m], (unsigned long long) h->count);
+        fprintf(out, "%s_sum %.6f\n", metric_names[m], (double) h->sum_us / 1e6);
+        fprintf(out, "%s_count %llu\n", metric_names[m], (unsigned long long) h->count);
+    }
+
+    fprintf(out, "# HELP chip8_frames_total Host frames run.\n"
+                 "# TYPE chip8_frames_total counter\n"
+                 "chip8_frames_total %llu\n", (unsigned long long) telemetry.frames);
+    fprintf(out, "# HELP chip8_late_frames_total Frames whose work exceeded the frame budget.\n"
+                 "# TYPE chip8_late_frames_total counter\n"
+                 "chip8_late_frames_total %llu\n", (unsigned long long) telemetry.late_frames);
+    fprintf(out, "# HELP chip8_dropped_frames_total Frame deadlines missed.\n"
+                 "# TYPE chip8_dropped_frames_total counter\n"
+                 "chip8_dropped_frames_total %llu\n", (unsigned long long) telemetry.dropped_frames);
+    fprintf(out, "# HELP chip8_instructions_total Instructions executed.\n"
+                 "# TYPE chip8_instructions_total counter\n"
+                 "chip8_instructions_total %llu\n", (unsigned long long) telemetry.instructions);
+    fprintf(out, "# HELP chip8_instructions_per_second Instructions per second over the last window.\n"
+                 "# TYPE chip8_instructions_per_second gauge\n"
+                 "chip8_instructions_per_second %.1f\n", telemetry.instr_per_sec);
+}
+
+static void serve_socket() {
+    char *stats = NULL;
+    size_t stats_len = 0;
+    int fd;
+
+    /* every pending connection gets one snapshot, then it is closed; the
+     * socket is non-blocking and a peer that already left does not raise
+     * SIGPIPE, so a scraper can never stall or kill the frame loop
+     */
+    while ((fd = accept4(telemetry.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if (!stats) {
+            FILE *out = open_memstream(&stats, &stats_len);
+            if (!out) {
+                close(fd);
+                return;
+            }
+            write_stats(out);
+            fclose(out);
+        }
+
+        send(fd, stats, stats_len, MSG_NOSIGNAL);
+        close(fd);
+    }
+
+    free(stats);
+}
+
+static void write_file() {
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof tmp_path, "%s.tmp", telemetry.export_path);
+
+    // write then rename so a scraper never sees a partial file
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) {
+        SDL_Log("Could not write telemetry file %s: %s", tmp_path, strerror(errno));
+        return;
+    }
+    write_stats(out);
+    fclose(out);
+
+    rename(tmp_path, telemetry.export_path);
+}
+
+void telemetry_export() {
+    if (telemetry.listen_fd >= 0) serve_socket();
+
+    const uint64_t now = telemetry_now_us();
+    const uint64_t window_us = now - telemetry.window_start_us;
+    if (window_us < TELEMETRY_EXPORT_MS * 1000) return;
+
+    telemetry.instr_per_sec = (double) telemetry.window_instructions * 1e6 / window_us;
+    telemetry.window_instructions = 0;
+    telemetry.window_start_us = now;
+
+    if (telemetry.export_path && telemetry.listen_fd < 0) write_file();
+}
+
+void telemetry_draw_overlay(SDL_Renderer *renderer, uint32_t width, uint32_t height) {
+    // frame budget sits at a quarter of the window height, bars are clipped at twice that
+    const uint32_t budget_h = height / 4;
+    const uint32_t bar_w = width / OVERLAY_SAMPLES ? width / OVERLAY_SAMPLES : 1;
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+
+    for (uint32_t i = 0; i < OVERLAY_SAMPLES; i++) {
+        // oldest sample on the left
+        const uint32_t us = telemetry.recent_us[(telemetry.recent_head + i) % OVERLAY_SAMPLES];
+        uint32_t h = (uint64_t) us * budget_h / FRAME_BUDGET_US;
+        if (h > budget_h * 2) h = budget_h * 2;
+
+        SDL_Rect r = {
+            .x = i * bar_w,
+            .y = height - h,
+            .w = bar_w,
+            .h = h,
+        };
+
+        if (us > FRAME_BUDGET_US)
+            SDL_SetRenderDrawColor(renderer, 0xFF, 0x40, 0x40, 0xC0);
+        else
+            SDL_SetRenderDrawColor(renderer, 0x40, 0xFF, 0x40, 0xC0);
+        SDL_RenderFillRect(renderer, &r);
+    }
+
+    // budget line
+    SDL_Rect line = {
+        .x = 0,
+        .y = height - budget_h,
+        .w = width,
+        .h = 1,
+    };
+    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0x00, 0xFF);
+    SDL_RenderFillRect(renderer, &line);
+}
@@ -0,0 +1,66 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+
+#define FRAME_BUDGET_US 16667       // 60 fps
+
+// histogram buckets are powers of two in microseconds: 1us, 2us ... 32.768ms, +Inf
+#define HISTOGRAM_BUCKETS 17
+
+#define OVERLAY_SAMPLES 64          // frames shown by the on-screen graph
+
+#define TELEMETRY_EXPORT_MS 1000    // how often stats are written out
+
+typedef enum {
+    TM_EMULATE,             // instruction batches + timer ticks
+    TM_RENDER,              // drawing the display into the renderer
+    TM_PRESENT,             // SDL_RenderPresent
+    TM_SLEEP_OVERSHOOT,     // time slept past the requested delay
+    TM_FRAME,               // full host frame, sleep included
+    TM_COUNT,
+} telemetry_metric_t;
+
+typedef struct {
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+} histogram_t;
+
+typedef struct {
+    histogram_t hist[TM_COUNT];
+    uint64_t frames;
+    uint64_t late_frames;       // work alone exceeded the frame budget
+    uint64_t dropped_frames;    // whole frame deadlines missed because of late frames
+    uint64_t instructions;
+    double instr_per_sec;       // achieved over the last export window
+
+    // overlay ring buffer of per-frame busy time
+    uint32_t recent_us[OVERLAY_SAMPLES];
+    uint32_t recent_head;
+
+    // export
+    const char *export_path;    // file path, or "unix:/path" for a socket
+    int listen_fd;
+    uint64_t window_start_us;
+    uint64_t window_instructions;
+} telemetry_t;
+
+bool telemetry_init(const char *export_path);
+
+void telemetry_quit();
+
+uint64_t telemetry_now_us();
+
+void telemetry_record(telemetry_metric_t metric, uint64_t us);
+
+void telemetry_end_frame(uint64_t busy_us, uint32_t instructions);
+
+void telemetry_export();
+
+void telemetry_draw_overlay(SDL_Renderer *renderer, uint32_t width, uint32_t height);
+
+#endif
@@ -0,0 +1,60 @@
+/* Re-sharding a batch that was already stepped must not let the new shard
+ * threads run a frame of their own: after batch_set_threads() the lanes
+ * stay where batch_reset() left them until the next batch_step().
+ *
+ * usage: batch_threads
+ */
+#define _POSIX_C_SOURCE 200809L     // nanosleep
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../batch.h"
+
+#define LANES 256
+
+// 7001 1200: V0 += 1 forever
+static const uint8_t rom[] = { 0x70, 0x01, 0x12, 0x00 };
+
+static bool check_v0(const chip8_batch_t *b, uint8_t expect, const char *when) {
+    for (uint32_t l = 0; l < b->lanes; l++) {
+        if (b->V[l] != expect) {
+            fprintf(stderr, "%s: lane %u has V0=%u, expected %u\n", when, l, b->V[l], expect);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main() {
+    chip8_batch_t *b = batch_create(LANES, rom, sizeof(rom), 2);
+    if (!b || !batch_set_threads(b, 4)) {
+        fprintf(stderr, "Could not create the batch\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t f = 0; f < 5; f++) batch_step(b, NULL, NULL, NULL);
+    bool ok = check_v0(b, 5, "after 5 frames");
+
+    batch_reset(b, 1);
+    if (!batch_set_threads(b, 2)) {
+        fprintf(stderr, "Could not re-shard the batch\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // give a thread that wrongly thinks a frame is pending the time to run it
+    nanosleep(&(struct timespec) { .tv_nsec = 50 * 1000 * 1000 }, NULL);
+    ok &= check_v0(b, 0, "after re-sharding");
+    if (b->pending != 0) {
+        fprintf(stderr, "after re-sharding: %u shards pending\n", b->pending);
+        ok = false;
+    }
+
+    batch_step(b, NULL, NULL, NULL);
+    ok &= check_v0(b, 1, "after 1 frame");
+
+    batch_destroy(b);
+
+    printf("batch_threads: %s\n", ok ? "ok" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}